@@ -0,0 +1,465 @@
+#ifndef OPENDATASOFT_MOCK_SERVER_H
+#define OPENDATASOFT_MOCK_SERVER_H
+
+#include <cpprest/http_listener.h>
+#include <cpprest/json.h>
+#include <pplx/pplx.h>
+#if !defined(_WIN32)
+#include <pplx/threadpool.h>
+#include <boost/asio/steady_timer.hpp>
+#endif
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <regex>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+// Local stand-in for the Explore v2.1 API, used by the benchmarks and for
+// offline runs. It serves canned responses for
+//   /catalog/datasets[/{id}], /catalog/exports[/{format}], /catalog/facets,
+//   /catalog/datasets/{id}/records[/{record_id}], .../facets, .../exports[/{format}]
+//   and .../attachments
+// Every dataset id exists and holds the same generated records, ordered by
+// their integer id field. Of the where clause only comparisons on id are
+// applied (id > 5, id >= "5", id = 5 OR id = 7, ...), which is what keyset
+// paging, partitioned bulk fetches and batch lookups send; other terms and
+// select, group_by and order_by are ignored. Payload size, latency and
+// error injection are set through Options.
+class OpenDataSoftMockServer {
+public:
+    struct Options {
+        size_t records;                     // records per dataset
+        size_t datasets;                    // datasets listed in the catalog
+        size_t text_bytes;                  // length of each record's name field
+        std::chrono::milliseconds latency;
+        std::chrono::milliseconds jitter;   // added uniformly in [0, jitter]
+        double error_rate;                  // share of requests answered with error_status
+        size_t fail_first;                  // requests answered with error_status before error_rate applies
+        int error_status;
+        int retry_after;                    // seconds, sent with injected errors when > 0
+
+        Options()
+            : records(5000), datasets(20), text_bytes(32), latency(0), jitter(0),
+              error_rate(0), fail_first(0), error_status(503), retry_after(0) {}
+    };
+
+    explicit OpenDataSoftMockServer(const Options& options = Options())
+        : options(options), random(std::random_device{}()) {
+        for (size_t i = 0; i < options.records; ++i) {
+            records.push_back(make_record(i));
+            csv_rows.push_back(make_csv_row(i));
+        }
+        etag = "\"mock-" + std::to_string(options.records) + "-" + std::to_string(options.text_bytes) + "\"";
+    }
+
+    ~OpenDataSoftMockServer() {
+        stop();
+    }
+
+    // Listens on base_url, e.g. "http://127.0.0.1:8089/api/explore/v2.1"
+    void start(const std::string& base_url) {
+        listener.reset(new web::http::experimental::listener::http_listener(utility::conversions::to_string_t(base_url)));
+        listener->support(web::http::methods::GET, [this](web::http::http_request request) { handle(request); });
+        listener->open().wait();
+    }
+
+    // Stops listening and waits for delayed replies still in flight
+    void stop() {
+        if (!listener) return;
+        listener->close().wait();
+        listener.reset();
+        while (pending > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint64_t requests_served() const { return requests; }
+    uint64_t errors_injected() const { return errors; }
+
+    // What /catalog/datasets/{id} and .../exports/{format} would return, for
+    // benchmarks that decode without a round trip
+    std::string dataset_body(const std::string& dataset_id) const { return dataset_info(dataset_id); }
+    std::string export_body(const std::string& format) const { return records_export(format, QueryMap()).body; }
+
+private:
+    typedef std::map<utility::string_t, utility::string_t> QueryMap;
+
+    struct Reply {
+        web::http::status_code status;
+        std::string body;
+        std::string content_type;
+    };
+
+    // Records matching the id comparisons of a where clause: a contiguous
+    // range, or an explicit list when the clause has equality terms
+    struct Selection {
+        size_t begin;
+        size_t end;
+        bool listed;
+        std::vector<size_t> ids;
+
+        size_t size() const { return listed ? ids.size() : end - begin; }
+        size_t at(size_t index) const { return listed ? ids[index] : begin + index; }
+    };
+
+    Options options;
+    std::unique_ptr<web::http::experimental::listener::http_listener> listener;
+    std::vector<std::string> records;
+    std::vector<std::string> csv_rows;
+    std::string etag;
+
+    std::mutex random_mutex;
+    std::mt19937_64 random;
+    std::atomic<int> pending{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+
+    static std::string to_utf8(const utility::string_t& text) {
+        return utility::conversions::to_utf8string(text);
+    }
+
+    static std::string param(const QueryMap& query, const char* name) {
+        auto it = query.find(utility::conversions::to_string_t(name));
+        return it == query.end() ? "" : to_utf8(web::uri::decode(it->second));
+    }
+
+    static int int_param(const QueryMap& query, const char* name, int fallback) {
+        std::string value = param(query, name);
+        return value.empty() ? fallback : std::atoi(value.c_str());
+    }
+
+    static std::string json_string(const std::string& text) {
+        std::string out = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    static std::string error_body(const std::string& code, const std::string& message) {
+        return "{\"error_code\": " + json_string(code) + ", \"message\": " + json_string(message) + "}";
+    }
+
+    static Reply json_reply(const std::string& body) {
+        Reply reply = {web::http::status_codes::OK, body, "application/json; charset=utf-8"};
+        return reply;
+    }
+
+    static Reply bad_request(const std::string& message) {
+        Reply reply = {web::http::status_codes::BadRequest, error_body("InvalidRESTParameterError", message),
+                       "application/json; charset=utf-8"};
+        return reply;
+    }
+
+    static Reply not_found() {
+        Reply reply = {web::http::status_codes::NotFound, error_body("NotFound", "Unknown endpoint"),
+                       "application/json; charset=utf-8"};
+        return reply;
+    }
+
+    // 2024-01-01T00:00:00 plus one minute per record
+    static std::string timestamp(size_t index) {
+        int64_t seconds = 1704067200 + static_cast<int64_t>(index) * 60;
+        int64_t days = seconds / 86400;
+        int64_t rest = seconds % 86400;
+        // Civil date from days since 1970-01-01 (Howard Hinnant's algorithm)
+        days += 719468;
+        int64_t era = days / 146097;
+        int64_t doe = days - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        int64_t day = doy - (153 * mp + 2) / 5 + 1;
+        int64_t month = mp < 10 ? mp + 3 : mp - 9;
+        int64_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d+00:00",
+                      static_cast<int>(year), static_cast<int>(month), static_cast<int>(day),
+                      static_cast<int>(rest / 3600), static_cast<int>(rest / 60 % 60), static_cast<int>(rest % 60));
+        return buffer;
+    }
+
+    std::string name_of(size_t index) const {
+        std::string name = "record-" + std::to_string(index);
+        if (name.size() < options.text_bytes) name.append(options.text_bytes - name.size(), 'x');
+        return name;
+    }
+
+    std::string make_record(size_t index) const {
+        char numbers[160];
+        std::snprintf(numbers, sizeof(numbers),
+                      "\"value\": %.2f, \"updated\": \"%s\", \"active\": %s, \"location\": {\"lon\": %.6f, \"lat\": %.6f}",
+                      index * 0.25, timestamp(index).c_str(), index % 2 == 0 ? "true" : "false",
+                      9.37 + (index % 1000) * 0.0001, 47.42 + (index % 997) * 0.0001);
+        return "{\"id\": " + std::to_string(index) + ", \"name\": " + json_string(name_of(index)) + ", " + numbers + "}";
+    }
+
+    std::string make_csv_row(size_t index) const {
+        char numbers[160];
+        std::snprintf(numbers, sizeof(numbers), "%.2f;%s;%s;%.6f, %.6f",
+                      index * 0.25, timestamp(index).c_str(), index % 2 == 0 ? "True" : "False",
+                      47.42 + (index % 997) * 0.0001, 9.37 + (index % 1000) * 0.0001);
+        return std::to_string(index) + ";" + name_of(index) + ";" + numbers;
+    }
+
+    std::string dataset_info(const std::string& dataset_id) const {
+        return "{\"dataset_id\": " + json_string(dataset_id) +
+               ", \"has_records\": true, \"metas\": {\"default\": {\"title\": " + json_string(dataset_id) +
+               ", \"records_count\": " + std::to_string(options.records) +
+               ", \"modified\": \"2024-01-01T00:00:00+00:00\", \"data_processed\": \"2024-01-01T00:00:00+00:00\"}}"
+               ", \"fields\": [{\"name\": \"id\", \"type\": \"int\"}, {\"name\": \"name\", \"type\": \"text\"}"
+               ", {\"name\": \"value\", \"type\": \"double\"}, {\"name\": \"updated\", \"type\": \"datetime\"}"
+               ", {\"name\": \"active\", \"type\": \"boolean\"}, {\"name\": \"location\", \"type\": \"geo_point_2d\"}]}";
+    }
+
+    Selection select(const std::string& where) const {
+        Selection selection = {0, records.size(), false, std::vector<size_t>()};
+        bool has_equality = false;
+        std::set<size_t> equal;
+        static const std::regex comparison("(^|[^A-Za-z0-9_])id\\s*(>=|<=|>|<|=)\\s*\"?(-?[0-9]+)\"?");
+        for (std::sregex_iterator it(where.begin(), where.end(), comparison), last; it != last; ++it) {
+            std::string op = (*it)[2];
+            long long value = std::atoll((*it)[3].str().c_str());
+            size_t bound = value < 0 ? 0 : std::min(static_cast<size_t>(value), records.size());
+            if (op == "=") {
+                has_equality = true;
+                if (value >= 0 && static_cast<size_t>(value) < records.size()) equal.insert(static_cast<size_t>(value));
+            } else if (op == ">") {
+                selection.begin = std::max(selection.begin, value < 0 ? 0 : std::min(bound + 1, records.size()));
+            } else if (op == ">=") {
+                selection.begin = std::max(selection.begin, bound);
+            } else if (op == "<") {
+                selection.end = std::min(selection.end, bound);
+            } else {
+                selection.end = std::min(selection.end, value < 0 ? 0 : std::min(bound + 1, records.size()));
+            }
+        }
+        if (selection.end < selection.begin) selection.end = selection.begin;
+        if (has_equality) {
+            selection.listed = true;
+            for (size_t id : equal) {
+                if (id >= selection.begin && id < selection.end) selection.ids.push_back(id);
+            }
+        }
+        return selection;
+    }
+
+    Reply records_page(const QueryMap& query) const {
+        int limit = int_param(query, "limit", 10);
+        int offset = int_param(query, "offset", 0);
+        if (limit < 0 || limit > 100) return bad_request("limit must be between 0 and 100");
+        if (offset < 0 || offset + limit > 10000) return bad_request("offset + limit must not exceed 10000");
+        Selection selection = select(param(query, "where"));
+        std::string body = "{\"total_count\": " + std::to_string(selection.size()) + ", \"results\": [";
+        for (size_t i = offset; i < selection.size() && i < static_cast<size_t>(offset + limit); ++i) {
+            if (i > static_cast<size_t>(offset)) body += ", ";
+            body += records[selection.at(i)];
+        }
+        return json_reply(body + "]}");
+    }
+
+    Reply records_export(const std::string& format, const QueryMap& query) const {
+        Selection selection = select(param(query, "where"));
+        int limit = int_param(query, "limit", -1);
+        size_t count = limit < 0 ? selection.size() : std::min(selection.size(), static_cast<size_t>(limit));
+        std::string body;
+        if (format == "json") {
+            body = "[";
+            for (size_t i = 0; i < count; ++i) {
+                if (i > 0) body += ", ";
+                body += records[selection.at(i)];
+            }
+            return json_reply(body + "]");
+        }
+        if (format == "jsonl") {
+            for (size_t i = 0; i < count; ++i) {
+                body += records[selection.at(i)];
+                body += "\n";
+            }
+            Reply reply = {web::http::status_codes::OK, body, "application/x-ndjson"};
+            return reply;
+        }
+        if (format == "csv") {
+            body = "id;name;value;updated;active;location\n";
+            for (size_t i = 0; i < count; ++i) {
+                body += csv_rows[selection.at(i)];
+                body += "\n";
+            }
+            Reply reply = {web::http::status_codes::OK, body, "text/csv; charset=utf-8"};
+            return reply;
+        }
+        return bad_request("Unsupported export format " + format);
+    }
+
+    Reply catalog_export(const std::string& format) const {
+        if (format == "json") {
+            std::string body = "[";
+            for (size_t i = 0; i < options.datasets; ++i) {
+                if (i > 0) body += ", ";
+                body += dataset_info("dataset-" + std::to_string(i));
+            }
+            return json_reply(body + "]");
+        }
+        if (format == "csv") {
+            std::string body = "dataset_id;title\n";
+            for (size_t i = 0; i < options.datasets; ++i) {
+                body += "dataset-" + std::to_string(i) + ";dataset-" + std::to_string(i) + "\n";
+            }
+            Reply reply = {web::http::status_codes::OK, body, "text/csv; charset=utf-8"};
+            return reply;
+        }
+        if (format.compare(0, 4, "dcat") == 0) {
+            Reply reply = {web::http::status_codes::OK, "<?xml version=\"1.0\"?><rdf:RDF/>", "application/rdf+xml"};
+            return reply;
+        }
+        return bad_request("Unsupported export format " + format);
+    }
+
+    Reply exports_list() const {
+        return json_reply("{\"links\": [{\"rel\": \"json\", \"href\": \"json\"}, {\"rel\": \"jsonl\", \"href\": \"jsonl\"}"
+                          ", {\"rel\": \"csv\", \"href\": \"csv\"}]}");
+    }
+
+    Reply route(const std::vector<std::string>& segments, const QueryMap& query) const {
+        if (segments.size() < 2 || segments[0] != "catalog") return not_found();
+        if (segments[1] == "exports") {
+            return segments.size() == 2 ? exports_list() : catalog_export(segments[2]);
+        }
+        if (segments[1] == "facets" && segments.size() == 2) {
+            return json_reply("{\"facets\": [{\"name\": \"publisher\", \"facets\": [{\"name\": \"Mock\", \"count\": " +
+                              std::to_string(options.datasets) + ", \"state\": \"displayed\", \"value\": \"Mock\"}]}]}");
+        }
+        if (segments[1] != "datasets") return not_found();
+
+        if (segments.size() == 2) {
+            int limit = int_param(query, "limit", 10);
+            int offset = int_param(query, "offset", 0);
+            if (limit < 0 || limit > 100) return bad_request("limit must be between 0 and 100");
+            std::string body = "{\"total_count\": " + std::to_string(options.datasets) + ", \"results\": [";
+            for (size_t i = offset < 0 ? 0 : offset, n = 0; i < options.datasets && n < static_cast<size_t>(limit); ++i, ++n) {
+                if (n > 0) body += ", ";
+                body += dataset_info("dataset-" + std::to_string(i));
+            }
+            return json_reply(body + "]}");
+        }
+
+        const std::string& dataset_id = segments[2];
+        if (segments.size() == 3) return json_reply(dataset_info(dataset_id));
+        const std::string& resource = segments[3];
+        if (resource == "records") {
+            if (segments.size() == 4) return records_page(query);
+            long long id = std::atoll(segments[4].c_str());
+            if (segments[4].find_first_not_of("0123456789") != std::string::npos || id < 0 ||
+                static_cast<size_t>(id) >= records.size()) {
+                Reply reply = {web::http::status_codes::NotFound, error_body("RecordNotFound", "Unknown record"),
+                               "application/json; charset=utf-8"};
+                return reply;
+            }
+            return json_reply(records[static_cast<size_t>(id)]);
+        }
+        if (resource == "exports") {
+            return segments.size() == 4 ? exports_list() : records_export(segments[4], query);
+        }
+        if (resource == "facets") {
+            size_t even = (records.size() + 1) / 2;
+            return json_reply("{\"facets\": [{\"name\": \"active\", \"facets\": [{\"name\": \"true\", \"count\": " +
+                              std::to_string(even) + ", \"state\": \"displayed\", \"value\": \"true\"}, {\"name\": \"false\", \"count\": " +
+                              std::to_string(records.size() - even) + ", \"state\": \"displayed\", \"value\": \"false\"}]}]}");
+        }
+        if (resource == "attachments") return json_reply("{\"links\": [], \"attachments\": []}");
+        return not_found();
+    }
+
+    bool inject_error(uint64_t request_number) {
+        if (request_number <= options.fail_first) return true;
+        if (options.error_rate <= 0) return false;
+        std::lock_guard<std::mutex> lock(random_mutex);
+        return std::uniform_real_distribution<double>(0, 1)(random) < options.error_rate;
+    }
+
+    std::chrono::milliseconds reply_delay() {
+        if (options.jitter.count() <= 0) return options.latency;
+        std::lock_guard<std::mutex> lock(random_mutex);
+        return options.latency + std::chrono::milliseconds(
+            std::uniform_int_distribution<int64_t>(0, options.jitter.count())(random));
+    }
+
+    void handle(web::http::http_request request) {
+        uint64_t request_number = ++requests;
+        web::http::http_response response;
+        try {
+            if (inject_error(request_number)) {
+                ++errors;
+                response.set_status_code(static_cast<web::http::status_code>(options.error_status));
+                if (options.retry_after > 0) {
+                    response.headers().add(U("Retry-After"), utility::conversions::to_string_t(std::to_string(options.retry_after)));
+                }
+                response.set_body(error_body("InjectedError", "Injected by the mock server"), "application/json; charset=utf-8");
+            } else {
+                auto uri = request.relative_uri();
+                std::vector<std::string> segments;
+                for (const auto& segment : web::uri::split_path(uri.path())) {
+                    segments.push_back(to_utf8(web::uri::decode(segment)));
+                }
+                Reply canned = route(segments, web::uri::split_query(uri.query()));
+                auto match = request.headers().find(U("If-None-Match"));
+                if (canned.status == web::http::status_codes::OK && match != request.headers().end() &&
+                    to_utf8(match->second) == etag) {
+                    response.set_status_code(web::http::status_codes::NotModified);
+                } else {
+                    response.set_status_code(canned.status);
+                    response.set_body(canned.body, canned.content_type);
+                }
+                if (canned.status == web::http::status_codes::OK) {
+                    response.headers().add(U("ETag"), utility::conversions::to_string_t(etag));
+                }
+            }
+        } catch (const std::exception& e) {
+            response = web::http::http_response(web::http::status_codes::InternalError);
+            response.set_body(error_body("InternalError", e.what()), "application/json; charset=utf-8");
+        }
+        reply(request, response);
+    }
+
+    // A client that went away makes the reply fail; that is not an error here
+    static void send(web::http::http_request& request, const web::http::http_response& response) {
+        request.reply(response).then([](pplx::task<void> sent) {
+            try {
+                sent.get();
+            } catch (const std::exception&) {
+            }
+        });
+    }
+
+    void reply(web::http::http_request request, web::http::http_response response) {
+        auto wait = reply_delay();
+        if (wait.count() <= 0) {
+            send(request, response);
+            return;
+        }
+        ++pending;
+#if !defined(_WIN32)
+        auto timer = std::make_shared<boost::asio::steady_timer>(crossplat::threadpool::shared_instance().service(), wait);
+        timer->async_wait([this, timer, request, response](const boost::system::error_code&) mutable {
+            send(request, response);
+            --pending;
+        });
+#else
+        pplx::create_task([this, wait, request, response]() mutable {
+            std::this_thread::sleep_for(wait);
+            send(request, response);
+            --pending;
+        });
+#endif
+    }
+};
+
+#endif
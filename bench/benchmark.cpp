@@ -0,0 +1,516 @@
+// Benchmarks every public OpenDataSoftAPI method plus paged and bulk pulls
+// against the mock server, reporting requests/sec, p50/p99 latency, heap
+// allocations per call and peak RSS.
+//
+//   opendatasoft_bench [--url URL | --port 18089] [--calls 200]
+//       [--concurrency 8] [--records 5000] [--latency-ms 0]
+//       [--error-rate 0] [--filter text] [--quick]
+//
+// Offline sections come first: decoding an /exports/json body into a
+// json::value tree versus RecordBatchDecoder columns, and building /records
+// endpoints the pre-OpenDataSoftQuery way versus with OpenDataSoftQuery.
+//
+// Without --url the mock server runs in this process, so allocation counts
+// include the server's share; start opendatasoft_mock_server separately and
+// pass --url for client-only numbers. The exit status is 1 if any call
+// failed while no errors were being injected.
+
+#include "OpenDataSoftAPI.h"
+#include "OpenDataSoftMockServer.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <cstdlib>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocation_bytes{0};
+
+}
+
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+uint64_t peak_rss_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+struct Result {
+    std::string name;
+    size_t calls;
+    size_t errors;
+    double seconds;
+    double p50_ms;
+    double p99_ms;
+    double allocations_per_call;
+    double bytes_per_call;
+    uint64_t peak_rss;
+};
+
+// Keeps concurrency calls outstanding until total calls have been made
+struct Runner {
+    std::function<pplx::task<bool>()> call;
+    std::atomic<int> remaining;
+    std::atomic<int> workers;
+    std::mutex mutex;
+    std::vector<double> latencies_ms;
+    size_t errors = 0;
+    pplx::task_completion_event<void> done;
+
+    static void next(const std::shared_ptr<Runner>& self) {
+        if (self->remaining.fetch_sub(1) <= 0) {
+            if (--self->workers == 0) self->done.set();
+            return;
+        }
+        auto started = std::chrono::steady_clock::now();
+        pplx::task<bool> pending;
+        try {
+            pending = self->call();
+        } catch (const std::exception&) {
+            pending = pplx::task_from_result(false);
+        }
+        pending.then([self, started](pplx::task<bool> finished) {
+            bool ok = false;
+            try {
+                ok = finished.get();
+            } catch (const std::exception&) {
+            }
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            {
+                std::lock_guard<std::mutex> lock(self->mutex);
+                self->latencies_ms.push_back(elapsed);
+                if (!ok) ++self->errors;
+            }
+            next(self);
+        });
+    }
+};
+
+double percentile(std::vector<double> values, double q) {
+    if (values.empty()) return 0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(q * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+Result run(const std::string& name, size_t calls, size_t concurrency, const std::function<pplx::task<bool>()>& call) {
+    // One untimed call warms up connections and lazily built state
+    try {
+        call().wait();
+    } catch (const std::exception&) {
+    }
+
+    auto runner = std::make_shared<Runner>();
+    runner->call = call;
+    runner->remaining = static_cast<int>(calls);
+    size_t workers = std::max<size_t>(1, std::min(concurrency, calls));
+    runner->workers = static_cast<int>(workers);
+
+    uint64_t count_before = allocation_count.load();
+    uint64_t bytes_before = allocation_bytes.load();
+    auto started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < workers; ++i) Runner::next(runner);
+    pplx::create_task(runner->done).wait();
+    auto elapsed = std::chrono::steady_clock::now() - started;
+
+    Result result;
+    result.name = name;
+    result.calls = calls;
+    result.seconds = std::chrono::duration<double>(elapsed).count();
+    std::lock_guard<std::mutex> lock(runner->mutex);
+    result.errors = runner->errors;
+    result.p50_ms = percentile(runner->latencies_ms, 0.50);
+    result.p99_ms = percentile(runner->latencies_ms, 0.99);
+    result.allocations_per_call = calls ? static_cast<double>(allocation_count.load() - count_before) / calls : 0;
+    result.bytes_per_call = calls ? static_cast<double>(allocation_bytes.load() - bytes_before) / calls : 0;
+    result.peak_rss = peak_rss_bytes();
+    return result;
+}
+
+void print_header() {
+    std::cout << std::left << std::setw(44) << "scenario" << std::right
+              << std::setw(7) << "calls" << std::setw(7) << "errors"
+              << std::setw(11) << "req/s" << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms"
+              << std::setw(12) << "allocs/call" << std::setw(12) << "KB/call" << std::setw(10) << "RSS MB" << "\n";
+}
+
+void print(const Result& r) {
+    std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed
+              << std::setw(7) << r.calls << std::setw(7) << r.errors
+              << std::setw(11) << std::setprecision(1) << (r.seconds > 0 ? r.calls / r.seconds : 0)
+              << std::setw(10) << std::setprecision(2) << r.p50_ms
+              << std::setw(10) << std::setprecision(2) << r.p99_ms
+              << std::setw(12) << std::setprecision(0) << r.allocations_per_call
+              << std::setw(12) << std::setprecision(1) << r.bytes_per_call / 1024
+              << std::setw(10) << std::setprecision(1) << r.peak_rss / (1024.0 * 1024.0) << std::endl;
+}
+
+bool succeeded(const json::value& result) {
+    return !(result.is_object() && result.has_field(U("error")));
+}
+
+pplx::task<bool> ok(pplx::task<json::value> call) {
+    return call.then([](json::value result) { return succeeded(result); });
+}
+
+pplx::task<bool> ok(pplx::task<std::shared_ptr<RecordBatch>> call) {
+    return call.then([](std::shared_ptr<RecordBatch> batch) { return batch->ok(); });
+}
+
+// Batch results succeed only when every entry did
+pplx::task<bool> all_ok(pplx::task<json::value> call) {
+    return call.then([](json::value result) {
+        return succeeded(result) && result.has_field(U("failed")) && result.at(U("failed")).as_number().to_uint64() == 0;
+    });
+}
+
+pplx::task<bool> drain(OpenDataSoftAPI::RecordCursor cursor) {
+    return cursor.next_batch().then([cursor](std::vector<json::value> records) {
+        if (records.empty()) return pplx::task_from_result(cursor.error().is_null());
+        return drain(cursor);
+    });
+}
+
+// In-process work timed over repeated runs, with no network involved
+struct Measurement {
+    std::string name;
+    size_t runs;
+    size_t units;           // records or queries per run
+    size_t bytes;           // input bytes per run, 0 when not meaningful
+    double seconds;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+};
+
+Measurement measure(const std::string& name, size_t runs, size_t units, size_t bytes, const std::function<bool()>& work) {
+    work();
+    uint64_t count_before = allocation_count.load();
+    uint64_t bytes_before = allocation_bytes.load();
+    auto started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; ++i) {
+        if (!work()) throw std::runtime_error(name + " failed");
+    }
+    Measurement m;
+    m.name = name;
+    m.runs = runs;
+    m.units = units;
+    m.bytes = bytes;
+    m.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    m.allocations = allocation_count.load() - count_before;
+    m.allocated_bytes = allocation_bytes.load() - bytes_before;
+    return m;
+}
+
+void print_measurement_header(const char* unit) {
+    std::cout << std::left << std::setw(44) << "scenario" << std::right
+              << std::setw(7) << "runs" << std::setw(12) << (std::string(unit) + "/s")
+              << std::setw(10) << "MB/s" << std::setw(14) << (std::string("allocs/") + unit)
+              << std::setw(12) << (std::string("B/") + unit) << std::setw(10) << "RSS MB" << "\n";
+}
+
+void print(const Measurement& m) {
+    double units = static_cast<double>(m.runs) * m.units;
+    std::cout << std::left << std::setw(44) << m.name << std::right << std::fixed
+              << std::setw(7) << m.runs
+              << std::setw(12) << std::setprecision(0) << (m.seconds > 0 ? units / m.seconds : 0)
+              << std::setw(10) << std::setprecision(1)
+              << (m.seconds > 0 && m.bytes ? m.runs * m.bytes / m.seconds / (1024.0 * 1024.0) : 0)
+              << std::setw(14) << std::setprecision(2) << (units ? m.allocations / units : 0)
+              << std::setw(12) << std::setprecision(0) << (units ? m.allocated_bytes / units : 0)
+              << std::setw(10) << std::setprecision(1) << peak_rss_bytes() / (1024.0 * 1024.0) << std::endl;
+}
+
+// The same /exports/json body decoded the way export_dataset does it
+// (extract_json into a json::value tree) and the way
+// export_dataset_columnar does it (RecordBatchDecoder into columns)
+void decode_benchmarks(const OpenDataSoftMockServer& source, size_t runs, const std::string& filter) {
+    RecordSchema schema = RecordSchema::from_dataset_info(json::value::parse(utility::conversions::to_string_t(source.dataset_body("mock-dataset"))));
+    std::string body = source.export_body("json");
+    size_t records = json::value::parse(utility::conversions::to_string_t(body)).size();
+
+    auto wanted = [&](const std::string& name) { return filter.empty() || name.find(filter) != std::string::npos; };
+    std::vector<Measurement> results;
+    if (wanted("decode extract_json (json::value)")) {
+        results.push_back(measure("decode extract_json (json::value)", runs, records, body.size(), [&]() {
+            json::value parsed = json::value::parse(utility::conversions::to_string_t(body));
+            return parsed.is_array() && parsed.size() == records;
+        }));
+    }
+    if (wanted("decode RecordBatchDecoder")) {
+        results.push_back(measure("decode RecordBatchDecoder", runs, records, body.size(), [&]() {
+            RecordBatch batch(schema);
+            RecordBatchDecoder decoder(schema);
+            return decoder.decode_response(body.data(), body.size(), batch) && batch.num_rows == records;
+        }));
+    }
+    if (results.empty()) return;
+    std::cout << "Decoding a " << records << "-record /exports/json body (" << body.size() / 1024 << " KB)\n";
+    print_measurement_header("record");
+    for (const auto& m : results) print(m);
+    std::cout << "\n";
+}
+
+// How /records endpoints were built before OpenDataSoftQuery: every value
+// converted to string_t and back, encoded into a std::map, then encoded
+// again while joining (which is why it double-encoded)
+std::string legacy_records_endpoint(const std::string& dataset_id, const std::string& select, const std::string& where,
+                                    const std::string& order_by, int limit, int offset) {
+    auto encode = [](const std::string& value) {
+        return utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(value)));
+    };
+    std::map<std::string, std::string> params;
+    if (!select.empty()) params["select"] = encode(select);
+    if (!where.empty()) params["where"] = encode(where);
+    if (!order_by.empty()) params["order_by"] = encode(order_by);
+    if (limit != 10) params["limit"] = std::to_string(limit);
+    if (offset != 0) params["offset"] = std::to_string(offset);
+    std::string query = "?";
+    bool first = true;
+    for (const auto& param : params) {
+        if (!first) query += "&";
+        query += param.first + "=" + encode(param.second);
+        first = false;
+    }
+    return "/catalog/datasets/" + encode(dataset_id) + "/records" + query;
+}
+
+// Building the endpoint of one /records page request, the old way and with
+// OpenDataSoftQuery built per request or reused across pages
+void query_benchmarks(size_t runs, const std::string& filter) {
+    const std::string dataset = "mock-dataset";
+    const std::string select = "id, name, value, updated";
+    const std::string where = "updated >= date'2024-01-01' AND name LIKE \"record-1*\"";
+    const std::string order_by = "id ASC";
+    const size_t pages = 1000;
+    size_t sink = 0;
+
+    auto wanted = [&](const std::string& name) { return filter.empty() || name.find(filter) != std::string::npos; };
+    std::vector<Measurement> results;
+    if (wanted("query legacy std::map + encode_data_string")) {
+        results.push_back(measure("query legacy std::map + encode_data_string", runs, pages, 0, [&]() {
+            for (size_t page = 0; page < pages; ++page) {
+                sink += legacy_records_endpoint(dataset, select, where, order_by, 100, static_cast<int>(page * 100)).size();
+            }
+            return sink > 0;
+        }));
+    }
+    if (wanted("query OpenDataSoftQuery per request")) {
+        results.push_back(measure("query OpenDataSoftQuery per request", runs, pages, 0, [&]() {
+            for (size_t page = 0; page < pages; ++page) {
+                OpenDataSoftQuery query;
+                query.select(select).where(where).order_by(order_by).limit(100).offset(static_cast<int>(page * 100));
+                sink += query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset) + "/records").size();
+            }
+            return sink > 0;
+        }));
+    }
+    if (wanted("query OpenDataSoftQuery reused")) {
+        results.push_back(measure("query OpenDataSoftQuery reused", runs, pages, 0, [&]() {
+            const std::string path = "/catalog/datasets/" + OpenDataSoftQuery::encode(dataset) + "/records";
+            OpenDataSoftQuery query;
+            query.select(select).where(where).order_by(order_by).limit(100);
+            for (size_t page = 0; page < pages; ++page) {
+                query.offset(static_cast<int>(page * 100));
+                sink += query.endpoint(path).size();
+            }
+            return sink > 0;
+        }));
+    }
+    if (results.empty()) return;
+    std::cout << "Building /records page endpoints (" << pages << " per run)\n";
+    print_measurement_header("query");
+    for (const auto& m : results) print(m);
+    std::cout << "\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::string url;
+    int port = 18089;
+    size_t calls = 200;
+    size_t concurrency = 8;
+    size_t pulls = 3;
+    std::string filter;
+    OpenDataSoftMockServer::Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--quick") {
+            calls = 20;
+            pulls = 1;
+            options.records = 500;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << flag << std::endl;
+            return 2;
+        }
+        const char* value = argv[++i];
+        if (flag == "--url") url = value;
+        else if (flag == "--port") port = std::atoi(value);
+        else if (flag == "--calls") calls = std::strtoul(value, nullptr, 10);
+        else if (flag == "--concurrency") concurrency = std::strtoul(value, nullptr, 10);
+        else if (flag == "--records") options.records = std::strtoul(value, nullptr, 10);
+        else if (flag == "--latency-ms") options.latency = std::chrono::milliseconds(std::atoi(value));
+        else if (flag == "--error-rate") options.error_rate = std::atof(value);
+        else if (flag == "--filter") filter = value;
+        else {
+            std::cerr << "Unknown option " << flag << std::endl;
+            return 2;
+        }
+    }
+
+    decode_benchmarks(OpenDataSoftMockServer(options), pulls * 10, filter);
+    query_benchmarks(pulls * 10, filter);
+
+    std::unique_ptr<OpenDataSoftMockServer> server;
+    if (url.empty()) {
+        url = "http://127.0.0.1:" + std::to_string(port) + "/api/explore/v2.1";
+        server.reset(new OpenDataSoftMockServer(options));
+        try {
+            server->start(url);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to start the mock server on " << url << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    OpenDataSoftAPI api(url, 16);
+    // Identical concurrent calls would otherwise share one request
+    api.set_request_coalescing(false);
+
+    const std::string dataset = "mock-dataset";
+    RecordSchema schema = api.get_dataset_schema(dataset).get();
+    if (schema.fields.empty()) {
+        std::cerr << "Could not read the dataset schema from " << url << std::endl;
+        return 1;
+    }
+    // The record count as the server reports it, which matters with --url
+    json::value counted = api.query_dataset_records(dataset, "", "", "", "", 0).get();
+    size_t records = counted.has_field(U("total_count")) ? static_cast<size_t>(counted.at(U("total_count")).as_number().to_uint64()) : 0;
+
+    std::vector<std::string> dataset_ids;
+    for (int i = 0; i < 20; ++i) dataset_ids.push_back("dataset-" + std::to_string(i));
+    std::vector<std::string> record_ids;
+    for (size_t i = 0; i < 50 && i < records; ++i) record_ids.push_back(std::to_string(i * 7 % records));
+    std::vector<std::string> bounds;
+    for (size_t i = 1; i < 8; ++i) bounds.push_back(std::to_string(records * i / 8));
+
+    OpenDataSoftAPI::Query page_query;
+    page_query.order_by("id").limit(100);
+    auto discard = [](const char*, size_t) {};
+    auto ignore_record = [](const json::value&) {};
+    OpenDataSoftAPI* client = &api;
+
+    struct Scenario {
+        std::string name;
+        size_t calls;
+        size_t concurrency;
+        std::function<pplx::task<bool>()> call;
+    };
+    // export_catalog_csv, export_dataset_csv and export_catalog_dcat parse
+    // their non-JSON bodies as JSON, so only their streaming variants are run.
+    std::vector<Scenario> scenarios = {
+        {"get_catalog_datasets", calls, concurrency, [=]() { return ok(client->get_catalog_datasets()); }},
+        {"get_catalog_exports", calls, concurrency, [=]() { return ok(client->get_catalog_exports()); }},
+        {"export_catalog json", calls, concurrency, [=]() { return ok(client->export_catalog("json")); }},
+        {"get_catalog_facets", calls, concurrency, [=]() { return ok(client->get_catalog_facets()); }},
+        {"get_dataset_info", calls, concurrency, [=]() { return ok(client->get_dataset_info(dataset)); }},
+        {"query_dataset_records limit=100", calls, concurrency, [=]() {
+            return ok(client->query_dataset_records(dataset, "", "", "", "id", 100)); }},
+        {"query_dataset_records (Query)", calls, concurrency, [=]() {
+            return ok(client->query_dataset_records(dataset, page_query)); }},
+        {"get_dataset_exports", calls, concurrency, [=]() { return ok(client->get_dataset_exports(dataset)); }},
+        {"export_dataset json", pulls * 4, concurrency, [=]() { return ok(client->export_dataset(dataset, "json")); }},
+        {"get_dataset_facets", calls, concurrency, [=]() { return ok(client->get_dataset_facets(dataset)); }},
+        {"get_dataset_attachments", calls, concurrency, [=]() { return ok(client->get_dataset_attachments(dataset)); }},
+        {"get_dataset_record", calls, concurrency, [=]() { return ok(client->get_dataset_record(dataset, "42")); }},
+        {"stream_export_catalog json", calls, concurrency, [=]() {
+            return ok(client->stream_export_catalog("json", discard)); }},
+        {"stream_export_catalog_csv", calls, concurrency, [=]() {
+            return ok(client->stream_export_catalog_csv(discard)); }},
+        {"stream_export_dataset jsonl", pulls * 4, concurrency, [=]() {
+            return ok(client->stream_export_dataset(dataset, "jsonl", discard)); }},
+        {"stream_export_dataset_csv", pulls * 4, concurrency, [=]() {
+            return ok(client->stream_export_dataset_csv(dataset, discard)); }},
+        {"query_dataset_records_columnar limit=100", calls, concurrency, [=]() {
+            return ok(client->query_dataset_records_columnar(dataset, schema, "", "", "id", 100)); }},
+        {"export_dataset_columnar", pulls * 4, concurrency, [=]() {
+            return ok(client->export_dataset_columnar(dataset, schema)); }},
+        {"get_dataset_infos x20", pulls * 4, 1, [=]() { return all_ok(client->get_dataset_infos(dataset_ids)); }},
+        {"get_dataset_records x50", pulls * 4, 1, [=]() {
+            return all_ok(client->get_dataset_records(dataset, record_ids)); }},
+        {"get_dataset_records x50 by id_field", pulls * 4, 1, [=]() {
+            return all_ok(client->get_dataset_records(dataset, record_ids, "", "", "", "id")); }},
+        {"paged pull (records_cursor)", pulls, 1, [=]() {
+            return drain(client->records_cursor(dataset, "", "", "", "", "", "", "", 100, 4, "id")); }},
+        {"bulk pull (offset windows)", pulls, 1, [=]() {
+            return ok(client->bulk_fetch_dataset(dataset, ignore_record, "", std::vector<std::string>(), "", "", "id")); }},
+        {"bulk pull (8 id partitions)", pulls, 1, [=]() {
+            return ok(client->bulk_fetch_dataset(dataset, ignore_record, "id", bounds)); }},
+    };
+
+    std::cout << "OpenDataSoftAPI benchmark against " << url << " (" << records << " records"
+              << (server ? ", in-process server: allocations include the server" : "") << ")\n";
+    print_header();
+    size_t failures = 0;
+    for (const auto& scenario : scenarios) {
+        if (!filter.empty() && scenario.name.find(filter) == std::string::npos) continue;
+        auto result = run(scenario.name, scenario.calls, scenario.concurrency, scenario.call);
+        print(result);
+        failures += result.errors;
+    }
+
+    if (server) server->stop();
+    bool expect_errors = options.error_rate > 0;
+    if (failures > 0 && !expect_errors) {
+        std::cerr << failures << " calls failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
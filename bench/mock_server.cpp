@@ -0,0 +1,52 @@
+// Runs the mock OpenDataSoft server until stdin closes or a line is read.
+//
+//   opendatasoft_mock_server [--port 8089] [--records 5000] [--datasets 20]
+//       [--text-bytes 32] [--latency-ms 0] [--jitter-ms 0]
+//       [--error-rate 0] [--error-status 503] [--retry-after 0]
+//
+// Point the client at it with
+//   OpenDataSoftAPI api("http://127.0.0.1:8089/api/explore/v2.1");
+
+#include "OpenDataSoftMockServer.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+int main(int argc, char** argv) {
+    OpenDataSoftMockServer::Options options;
+    int port = 8089;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        const char* value = argv[i + 1];
+        if (flag == "--port") port = std::atoi(value);
+        else if (flag == "--records") options.records = std::strtoul(value, nullptr, 10);
+        else if (flag == "--datasets") options.datasets = std::strtoul(value, nullptr, 10);
+        else if (flag == "--text-bytes") options.text_bytes = std::strtoul(value, nullptr, 10);
+        else if (flag == "--latency-ms") options.latency = std::chrono::milliseconds(std::atoi(value));
+        else if (flag == "--jitter-ms") options.jitter = std::chrono::milliseconds(std::atoi(value));
+        else if (flag == "--error-rate") options.error_rate = std::atof(value);
+        else if (flag == "--error-status") options.error_status = std::atoi(value);
+        else if (flag == "--retry-after") options.retry_after = std::atoi(value);
+        else {
+            std::cerr << "Unknown option " << flag << std::endl;
+            return 2;
+        }
+    }
+
+    std::string base_url = "http://127.0.0.1:" + std::to_string(port) + "/api/explore/v2.1";
+    OpenDataSoftMockServer server(options);
+    try {
+        server.start(base_url);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to listen on " << base_url << ": " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Serving " << options.records << " records per dataset at " << base_url << std::endl;
+    std::cout << "Press Enter to stop" << std::endl;
+
+    std::string line;
+    std::getline(std::cin, line);
+    server.stop();
+    std::cout << server.requests_served() << " requests served, " << server.errors_injected() << " errors injected" << std::endl;
+    return 0;
+}
@@ -3,22 +3,503 @@
 
 #include <cpprest/http_client.h>
 #include <cpprest/json.h>
+#include <cpprest/http_compression.h>
 #include <pplx/pplx.h>
+#if !defined(_WIN32)
+#include <pplx/threadpool.h>
+#include <boost/asio/steady_timer.hpp>
+#endif
+#include "OpenDataSoftRecordBatch.h"
+#include "OpenDataSoftQuery.h"
 #include <iostream>
 #include <string>
 #include <map>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <list>
+#include <unordered_map>
+#include <sstream>
+#include <cstdio>
+#include <thread>
+#include <condition_variable>
+#include <iterator>
+#include <random>
+#include <cmath>
+#include <algorithm>
 
 using namespace web;
 using namespace web::http;
 using namespace web::http::client;
 
 class OpenDataSoftAPI {
+public:
+    typedef OpenDataSoftQuery Query;
+
+    // Connection counts are estimates derived from request concurrency, not
+    // socket events: cpprest does not report when it opens or reuses a
+    // connection, so a server that closes every connection still shows reuse.
+    struct ConnectionStats {
+        uint64_t estimated_opened;
+        uint64_t estimated_reused;
+        size_t in_flight;
+        size_t max_connections;
+        uint64_t retries;
+        uint64_t hedges;
+        uint64_t throttled;
+    };
+
+    struct CacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t revalidations;
+        uint64_t evictions;
+        size_t entries;
+        size_t memory_bytes;
+    };
+
+    // Latency distribution with power-of-two buckets: buckets[i] counts
+    // durations in [2^i, 2^(i+1)) microseconds (bucket 0 also holds 0).
+    struct HistogramSnapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count;
+        uint64_t sum_us;
+
+        // Upper bound of the bucket holding quantile q, in microseconds
+        uint64_t percentile(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(std::ceil(q * count));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets.size(); ++i) {
+                seen += buckets[i];
+                if (seen >= rank && seen > 0) return uint64_t(2) << i;
+            }
+            return uint64_t(2) << (buckets.size() - 1);
+        }
+    };
+
+    // Per-endpoint counters. Endpoints are grouped by route, e.g.
+    // "/catalog/datasets/{dataset_id}/records". Phases:
+    //   queue - waiting for a connection slot, per attempt
+    //   ttfb  - request sent until response headers, per attempt; includes
+    //           DNS, connect and TLS, which cpprest does not report apart
+    //   body  - reading and parsing (or streaming) the response body
+    //   total - whole call, including cache hits, retries and backoff
+    struct EndpointMetrics {
+        std::string endpoint;
+        uint64_t calls;
+        uint64_t attempts;
+        uint64_t response_bytes;
+        uint64_t cache_hits;
+        uint64_t cache_misses;
+        uint64_t cache_revalidations;
+        uint64_t coalesced;
+        uint64_t status_classes[6];    // [0]: no response, [n]: nxx
+        HistogramSnapshot queue;
+        HistogramSnapshot ttfb;
+        HistogramSnapshot body;
+        HistogramSnapshot total;
+    };
+
+    // Retries of idempotent (GET) calls after 408/429/5xx responses and
+    // transport errors. The wait before attempt n + 1 is drawn uniformly from
+    // [0, min(max_delay, base_delay * 2^n)], or honours Retry-After if longer.
+    struct RetryPolicy {
+        int max_attempts;
+        std::chrono::milliseconds base_delay;
+        std::chrono::milliseconds max_delay;
+
+        RetryPolicy(int attempts = 3,
+                    std::chrono::milliseconds base = std::chrono::milliseconds(200),
+                    std::chrono::milliseconds max = std::chrono::milliseconds(10000))
+            : max_attempts(attempts < 1 ? 1 : attempts), base_delay(base), max_delay(max) {}
+    };
+
+    // Receives records one at a time, in order
+    typedef std::function<void(const json::value& record)> RecordSink;
+
+    // Reports (partitions done, partitions total, records delivered)
+    typedef std::function<void(size_t, size_t, uint64_t)> ProgressCallback;
+
+    // Receives an export body chunk by chunk, in order
+    typedef std::function<void(const char* data, size_t size)> ExportSink;
+
+    // Cancellation and deadline for one call. Cancelling token, or letting
+    // timeout (0 = none) pass, aborts the HTTP request and any retry wait;
+    // the call then resolves to an error object ("Request canceled" or
+    // "Deadline exceeded"). Calls with options are never coalesced.
+    struct CallOptions {
+        pplx::cancellation_token token;
+        std::chrono::milliseconds timeout;
+
+        CallOptions(pplx::cancellation_token t = pplx::cancellation_token::none(),
+                    std::chrono::milliseconds limit = std::chrono::milliseconds(0))
+            : token(t), timeout(limit) {}
+
+        explicit CallOptions(std::chrono::milliseconds limit)
+            : token(pplx::cancellation_token::none()), timeout(limit) {}
+
+        bool empty() const { return !token.is_cancelable() && timeout.count() <= 0; }
+    };
+
+    static ExportSink ostream_sink(std::ostream& out) {
+        return [&out](const char* data, size_t size) {
+            out.write(data, size);
+            if (!out) throw std::runtime_error("Failed to write export to stream");
+        };
+    }
+
+    static ExportSink file_sink(const std::string& path) {
+        auto file = std::make_shared<std::ofstream>(path, std::ios::binary | std::ios::trunc);
+        return [file, path](const char* data, size_t size) {
+            file->write(data, size);
+            if (!*file) throw std::runtime_error("Failed to write export to " + path);
+        };
+    }
+
 private:
+    // The records endpoint rejects offset + limit beyond this
+    static const int max_offset_window = 10000;
+
+    // One long-lived http_client shared by every call. cpprest pools and
+    // reuses keep-alive connections per client, so the handshake is only paid
+    // when more requests are in flight than there are idle connections. The
+    // pool is held through a shared_ptr so pending tasks keep it alive.
+    struct ConnectionPool {
+        std::unique_ptr<http_client> client;
+        size_t max_connections;
+
+        std::mutex mutex;
+        size_t in_flight = 0;
+        size_t open_connections = 0;
+        std::chrono::steady_clock::time_point last_release;
+
+        struct Waiter {
+            uint64_t id = 0;
+            pplx::task_completion_event<void> ready;
+            pplx::cancellation_token token = pplx::cancellation_token::none();
+            pplx::cancellation_token_registration registration;
+            bool registered = false;
+        };
+        std::deque<Waiter> waiters;
+        uint64_t next_waiter = 0;
+
+        std::atomic<uint64_t> estimated_opened{0};
+        std::atomic<uint64_t> estimated_reused{0};
+
+        ConnectionPool(const std::string& base, const http_client_config& config, size_t max_conns)
+            : client(new http_client(utility::conversions::to_string_t(base), config)),
+              max_connections(max_conns == 0 ? 1 : max_conns) {}
+
+        // Waits (without blocking a thread) until fewer than max_connections
+        // requests are in flight. Canceling token while waiting leaves the
+        // queue and fails the task with pplx::task_canceled.
+        pplx::task<void> acquire(const pplx::cancellation_token& token = pplx::cancellation_token::none()) {
+            if (token.is_canceled()) return pplx::task_from_exception<void>(pplx::task_canceled());
+            std::unique_lock<std::mutex> lock(mutex);
+            if (in_flight < max_connections) {
+                take_slot();
+                return pplx::task_from_result();
+            }
+            Waiter waiter;
+            waiter.id = next_waiter++;
+            waiters.push_back(waiter);
+            auto ready = pplx::create_task(waiter.ready);
+            if (!token.is_cancelable()) return ready;
+            lock.unlock();
+
+            // The callback may capture this: release() deregisters it when
+            // the waiter gets a slot, and a canceled waiter is already gone
+            uint64_t id = waiter.id;
+            auto registration = token.register_callback([this, id]() { cancel_waiter(id); });
+            lock.lock();
+            auto it = find_waiter(id);
+            if (it != waiters.end()) {
+                it->token = token;
+                it->registration = registration;
+                it->registered = true;
+                return ready;
+            }
+            lock.unlock();
+            token.deregister_callback(registration);
+            return ready;
+        }
+
+        // Takes a slot only if one is free right away
+        bool try_acquire() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (in_flight >= max_connections) return false;
+            take_slot();
+            return true;
+        }
+
+        void release() {
+            Waiter next;
+            bool hand_over = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --in_flight;
+                last_release = std::chrono::steady_clock::now();
+                if (!waiters.empty()) {
+                    next = waiters.front();
+                    waiters.pop_front();
+                    take_slot();
+                    hand_over = true;
+                }
+            }
+            if (!hand_over) return;
+            if (next.registered) next.token.deregister_callback(next.registration);
+            next.ready.set();
+        }
+
+    private:
+        std::deque<Waiter>::iterator find_waiter(uint64_t id) {
+            return std::find_if(waiters.begin(), waiters.end(), [id](const Waiter& waiter) { return waiter.id == id; });
+        }
+
+        void cancel_waiter(uint64_t id) {
+            pplx::task_completion_event<void> ready;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = find_waiter(id);
+                if (it == waiters.end()) return;
+                ready = it->ready;
+                waiters.erase(it);
+            }
+            ready.set_exception(pplx::task_canceled());
+        }
+
+        // Connection counts are estimated from concurrency: a request is
+        // assumed to reuse an idle connection unless in-flight requests exceed
+        // the number opened so far, or the idle ones have timed out. Servers
+        // that answer with Connection: close make the estimate too low.
+        void take_slot() {
+            // cpprest drops connections that stay idle for 30 seconds
+            if (in_flight == 0 && open_connections > 0 &&
+                std::chrono::steady_clock::now() - last_release > std::chrono::seconds(30)) {
+                open_connections = 0;
+            }
+            ++in_flight;
+            if (in_flight > open_connections) {
+                open_connections = in_flight;
+                ++estimated_opened;
+            } else {
+                ++estimated_reused;
+            }
+        }
+    };
+
+    // Writes to a temporary file and renames it over path, so readers never
+    // see a partially written file
+    static bool write_file_atomically(const std::string& path, const std::string& content) {
+        std::string temp = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(content.data(), content.size());
+            if (!out) {
+                out.close();
+                std::remove(temp.c_str());
+                return false;
+            }
+        }
+        if (std::rename(temp.c_str(), path.c_str()) != 0) {
+            std::remove(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Cached GET response, keyed by base URL, endpoint and query string
+    struct CacheEntry {
+        json::value body;
+        utility::string_t etag;
+        utility::string_t last_modified;
+        std::chrono::system_clock::time_point expires;
+        size_t bytes;
+    };
+
+    // LRU memory tier bounded by a byte budget, backed by an optional
+    // directory with one file per entry. Stale entries are kept so they can
+    // be revalidated with a conditional GET.
+    struct ResponseCache {
+        size_t memory_budget;
+        std::string directory;
+        std::chrono::seconds default_ttl;
+        std::map<std::string, std::chrono::seconds> ttls;
+
+        mutable std::mutex mutex;
+        std::list<std::string> lru;
+        std::unordered_map<std::string, std::pair<std::shared_ptr<const CacheEntry>, std::list<std::string>::iterator>> entries;
+        size_t memory_bytes = 0;
+
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> revalidations{0};
+        std::atomic<uint64_t> evictions{0};
+
+        // The longest matching endpoint prefix decides the TTL. Exports are
+        // not cached unless a rule names them: they are often far larger
+        // than the responses the cache is meant for.
+        std::chrono::seconds ttl_for(const std::string& endpoint) const {
+            auto route = Metrics::route_of(endpoint);
+            bool is_export = route == Metrics::CatalogExports || route == Metrics::DatasetExports;
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string path = endpoint.substr(0, endpoint.find('?'));
+            std::chrono::seconds ttl = is_export ? std::chrono::seconds(0) : default_ttl;
+            size_t matched = 0;
+            for (const auto& rule : ttls) {
+                if (rule.first.size() >= matched && path.compare(0, rule.first.size(), rule.first) == 0) {
+                    ttl = rule.second;
+                    matched = rule.first.size();
+                }
+            }
+            return ttl;
+        }
+
+        std::shared_ptr<const CacheEntry> lookup(const std::string& key) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = entries.find(key);
+                if (it != entries.end()) {
+                    lru.splice(lru.begin(), lru, it->second.second);
+                    return it->second.first;
+                }
+            }
+            auto entry = read_file(key);
+            if (entry) {
+                std::lock_guard<std::mutex> lock(mutex);
+                insert(key, entry);
+            }
+            return entry;
+        }
+
+        void store(const std::string& key, const json::value& body, const utility::string_t& etag,
+                   const utility::string_t& last_modified, std::chrono::seconds ttl) {
+            auto entry = std::make_shared<CacheEntry>();
+            entry->body = body;
+            entry->etag = etag;
+            entry->last_modified = last_modified;
+            entry->expires = std::chrono::system_clock::now() + ttl;
+            auto serialized = body.serialize();
+            entry->bytes = key.size() + serialized.size() * sizeof(utility::char_t);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                insert(key, entry);
+            }
+            // Entries larger than the whole budget are not kept in either
+            // tier; an older copy on disk would only be revalidated again
+            if (entry->bytes > memory_budget) {
+                remove_file(key);
+                return;
+            }
+            write_file(key, *entry, serialized);
+        }
+
+        // A 304 confirmed the entry; extend its lifetime
+        void revalidate(const std::string& key, const CacheEntry& stale, std::chrono::seconds ttl) {
+            ++revalidations;
+            store(key, stale.body, stale.etag, stale.last_modified, ttl);
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+            lru.clear();
+            memory_bytes = 0;
+        }
+
+    private:
+        void insert(const std::string& key, const std::shared_ptr<const CacheEntry>& entry) {
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                memory_bytes -= it->second.first->bytes;
+                lru.erase(it->second.second);
+                entries.erase(it);
+            }
+            if (entry->bytes > memory_budget) return;
+            lru.push_front(key);
+            entries[key] = std::make_pair(entry, lru.begin());
+            memory_bytes += entry->bytes;
+            while (memory_bytes > memory_budget) {
+                auto victim = entries.find(lru.back());
+                memory_bytes -= victim->second.first->bytes;
+                entries.erase(victim);
+                lru.pop_back();
+                ++evictions;
+            }
+        }
+
+        std::string file_for(const std::string& key) const {
+            std::ostringstream name;
+            name << directory << "/" << std::hex << std::hash<std::string>()(key) << ".json";
+            return name.str();
+        }
+
+        void remove_file(const std::string& key) const {
+            if (!directory.empty()) std::remove(file_for(key).c_str());
+        }
+
+        void write_file(const std::string& key, const CacheEntry& entry, const utility::string_t& serialized_body) const {
+            if (directory.empty()) return;
+            json::value meta;
+            meta[U("key")] = json::value::string(utility::conversions::to_string_t(key));
+            meta[U("etag")] = json::value::string(entry.etag);
+            meta[U("last_modified")] = json::value::string(entry.last_modified);
+            meta[U("expires")] = json::value::number(static_cast<int64_t>(
+                std::chrono::duration_cast<std::chrono::seconds>(entry.expires.time_since_epoch()).count()));
+
+            // Metadata on the first line, body on the second
+            write_file_atomically(file_for(key), utility::conversions::to_utf8string(meta.serialize()) + "\n" +
+                                                 utility::conversions::to_utf8string(serialized_body));
+        }
+
+        std::shared_ptr<const CacheEntry> read_file(const std::string& key) const {
+            if (directory.empty()) return nullptr;
+            std::ifstream in(file_for(key), std::ios::binary);
+            if (!in) return nullptr;
+            std::string meta_line;
+            std::getline(in, meta_line);
+            std::string body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            try {
+                auto meta = json::value::parse(utility::conversions::to_string_t(meta_line));
+                if (utility::conversions::to_utf8string(meta.at(U("key")).as_string()) != key) return nullptr;
+                auto entry = std::make_shared<CacheEntry>();
+                entry->body = json::value::parse(utility::conversions::to_string_t(body));
+                entry->etag = meta.at(U("etag")).as_string();
+                entry->last_modified = meta.at(U("last_modified")).as_string();
+                entry->expires = std::chrono::system_clock::time_point(std::chrono::seconds(meta.at(U("expires")).as_number().to_int64()));
+                entry->bytes = key.size() + body.size();
+                return entry;
+            } catch (const std::exception&) {
+                return nullptr;
+            }
+        }
+    };
+
+    // Identical GET calls that are in flight at the same time share one request
+    struct InFlightCalls {
+        std::mutex mutex;
+        std::unordered_map<std::string, pplx::task<json::value>> calls;
+        std::atomic<uint64_t> coalesced{0};
+    };
+
     std::string api_base = "https://daten.sg.ch/api/explore/v2.1";
+    utility::string_t host = U("daten.sg.ch");
     http_client_config client_config;
+    std::shared_ptr<ConnectionPool> pool;
+    std::shared_ptr<ResponseCache> cache;
+    std::shared_ptr<InFlightCalls> in_flight_calls = std::make_shared<InFlightCalls>();
+    bool coalesce_requests = true;
     
-    http_request create_request(const std::string& endpoint, const std::string& method) {
+    static http_request create_request(const std::string& endpoint, const std::string& method, const utility::string_t& host) {
         http_request request;
         
         if (method == "GET") {
@@ -34,61 +515,1605 @@ private:
         request.set_request_uri(utility::conversions::to_string_t(endpoint));
         
         // Set headers
-        request.headers().add(U("Host"), U("daten.sg.ch"));
+        request.headers().add(U("Host"), host);
         request.headers().add(U("Content-Type"), U("application/json"));
         request.headers().add(U("User-Agent"), U("Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0"));
         
         return request;
     }
     
-    std::string build_query_params(const std::map<std::string, std::string>& params) {
-        if (params.empty()) return "";
-        
-        std::string query = "?";
-        bool first = true;
-        for (const auto& param : params) {
-            if (!param.second.empty()) {
-                if (!first) query += "&";
-                auto encoded_value = web::uri::encode_data_string(utility::conversions::to_string_t(param.second));
-                query += param.first + "=" + utility::conversions::to_utf8string(encoded_value);
-                first = false;
+    static json::value make_error(const utility::string_t& message) {
+        json::value error_obj;
+        error_obj[U("error")] = json::value::string(message);
+        error_obj[U("success")] = json::value::boolean(false);
+        return error_obj;
+    }
+
+    // Formats a JSON value as an ODSQL literal for use in a where clause
+    static std::string odsql_literal(const json::value& value) {
+        if (!value.is_string()) return utility::conversions::to_utf8string(value.serialize());
+        std::string text = utility::conversions::to_utf8string(value.as_string());
+        std::string literal = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') literal += '\\';
+            literal += c;
+        }
+        return literal + "\"";
+    }
+
+    // A record id as an ODSQL literal: integers in canonical form (no
+    // leading zeros or plus sign) stay numeric so they match int fields,
+    // anything else is quoted
+    static std::string id_literal(const std::string& record_id) {
+        size_t digits = record_id.compare(0, 1, "-") == 0 ? 1 : 0;
+        bool integer = record_id.size() > digits && record_id.size() - digits <= 18 &&
+                       record_id.find_first_not_of("0123456789", digits) == std::string::npos &&
+                       (record_id[digits] != '0' || record_id.size() == digits + 1) && record_id != "-0";
+        return integer ? record_id : odsql_literal(json::value::string(utility::conversions::to_string_t(record_id)));
+    }
+
+    static utility::string_t header_value(const http_response& response, const utility::string_t& name) {
+        auto it = response.headers().find(name);
+        return it == response.headers().end() ? utility::string_t() : it->second;
+    }
+
+    struct LatencyHistogram {
+        static const size_t bucket_count = 32;
+        std::atomic<uint64_t> buckets[bucket_count];
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_us{0};
+
+        LatencyHistogram() {
+            for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+        }
+
+        void record(std::chrono::steady_clock::duration elapsed) {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+            uint64_t value = us > 0 ? static_cast<uint64_t>(us) : 0;
+            size_t bucket = 0;
+            while (bucket + 1 < bucket_count && (value >> (bucket + 1)) != 0) ++bucket;
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            sum_us.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        HistogramSnapshot snapshot() const {
+            HistogramSnapshot result;
+            for (const auto& bucket : buckets) result.buckets.push_back(bucket.load(std::memory_order_relaxed));
+            result.count = count.load(std::memory_order_relaxed);
+            result.sum_us = sum_us.load(std::memory_order_relaxed);
+            return result;
+        }
+    };
+
+    struct EndpointStats {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> attempts{0};
+        std::atomic<uint64_t> response_bytes{0};
+        std::atomic<uint64_t> cache_hits{0};
+        std::atomic<uint64_t> cache_misses{0};
+        std::atomic<uint64_t> cache_revalidations{0};
+        std::atomic<uint64_t> coalesced{0};
+        std::atomic<uint64_t> status_classes[6];
+        LatencyHistogram queue;
+        LatencyHistogram ttfb;
+        LatencyHistogram body;
+        LatencyHistogram total;
+
+        EndpointStats() {
+            for (auto& status : status_classes) status.store(0, std::memory_order_relaxed);
+        }
+
+        void record_status(int status) {
+            int status_class = status >= 100 && status < 600 ? status / 100 : 0;
+            status_classes[status_class].fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    // One slot per route, so recording never takes a lock
+    struct Metrics {
+        enum Route {
+            CatalogDatasets,
+            CatalogExports,
+            CatalogFacets,
+            Dataset,
+            DatasetRecords,
+            DatasetRecord,
+            DatasetExports,
+            DatasetFacets,
+            DatasetAttachments,
+            Other,
+            RouteCount
+        };
+
+        EndpointStats routes[RouteCount];
+
+        static const char* route_name(int route) {
+            static const char* const names[RouteCount] = {
+                "/catalog/datasets",
+                "/catalog/exports/{format}",
+                "/catalog/facets",
+                "/catalog/datasets/{dataset_id}",
+                "/catalog/datasets/{dataset_id}/records",
+                "/catalog/datasets/{dataset_id}/records/{record_id}",
+                "/catalog/datasets/{dataset_id}/exports/{format}",
+                "/catalog/datasets/{dataset_id}/facets",
+                "/catalog/datasets/{dataset_id}/attachments",
+                "other"
+            };
+            return names[route];
+        }
+
+        static Route route_of(const std::string& endpoint) {
+            std::vector<std::string> segments;
+            size_t end = endpoint.find('?');
+            if (end == std::string::npos) end = endpoint.size();
+            size_t start = 0;
+            while (start < end) {
+                size_t slash = endpoint.find('/', start);
+                if (slash == std::string::npos || slash > end) slash = end;
+                if (slash > start) segments.push_back(endpoint.substr(start, slash - start));
+                start = slash + 1;
             }
+            if (segments.size() < 2 || segments[0] != "catalog") return Other;
+            if (segments[1] == "exports") return CatalogExports;
+            if (segments[1] == "facets") return segments.size() == 2 ? CatalogFacets : Other;
+            if (segments[1] != "datasets") return Other;
+            if (segments.size() == 2) return CatalogDatasets;
+            if (segments.size() == 3) return Dataset;
+            if (segments[3] == "records") return segments.size() == 4 ? DatasetRecords : DatasetRecord;
+            if (segments[3] == "exports") return DatasetExports;
+            if (segments[3] == "facets") return DatasetFacets;
+            if (segments[3] == "attachments") return DatasetAttachments;
+            return Other;
+        }
+
+        static std::shared_ptr<EndpointStats> stats_for(const std::shared_ptr<Metrics>& metrics, const std::string& endpoint) {
+            if (!metrics) return nullptr;
+            return std::shared_ptr<EndpointStats>(metrics, &metrics->routes[route_of(endpoint)]);
         }
-        return query;
+    };
+
+    // Phase timing of one logical call
+    struct CallMetrics {
+        std::shared_ptr<EndpointStats> stats;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point body_started;
+
+        explicit CallMetrics(const std::shared_ptr<EndpointStats>& s)
+            : stats(s), started(std::chrono::steady_clock::now()) {}
+
+        void received() { body_started = std::chrono::steady_clock::now(); }
+
+        void finished(uint64_t bytes) {
+            auto now = std::chrono::steady_clock::now();
+            if (body_started != std::chrono::steady_clock::time_point()) stats->body.record(now - body_started);
+            stats->total.record(now - started);
+            stats->response_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            stats->calls.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    // The Metrics calls record into, null while metrics are disabled. It is
+    // swapped while calls run, so it is only read and written through
+    // std::atomic_load/atomic_store, which take a mutex in libstdc++; the
+    // enabled flag is checked first so calls pay one atomic read while
+    // metrics are off. Shared by copies of the API object, like the pool.
+    struct MetricsSlot {
+        std::atomic<bool> enabled{false};
+        std::shared_ptr<Metrics> current;
+    };
+
+    std::shared_ptr<MetricsSlot> metrics = std::make_shared<MetricsSlot>();
+
+    std::shared_ptr<Metrics> current_metrics() const {
+        if (!metrics->enabled.load(std::memory_order_acquire)) return nullptr;
+        return std::atomic_load(&metrics->current);
     }
-    
-    pplx::task<json::value> make_api_call(const std::string& endpoint, const std::string& method) {
-        http_client client(utility::conversions::to_string_t(api_base), client_config);
-        auto request = create_request(endpoint, method);
 
-        return client.request(request)
-            .then([](http_response response) {
+    std::shared_ptr<CallMetrics> start_call(const std::string& endpoint) const {
+        auto current = current_metrics();
+        if (!current) return nullptr;
+        return std::make_shared<CallMetrics>(Metrics::stats_for(current, endpoint));
+    }
+
+    // Rate limiting, retry and hedging state shared by all calls
+    struct RequestControl {
+        std::mutex mutex;
+
+        // Token bucket; rate 0 means unlimited. A 429 pauses all requests for
+        // Retry-After, limited or not, and halves the rate (down to a tenth
+        // of the configured one); each success adds back a twentieth of the
+        // configured rate.
+        double max_rate = 0;
+        double rate = 0;
+        double burst = 1;
+        double tokens = 1;
+        std::chrono::steady_clock::time_point refilled = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point paused_until;
+
+        RetryPolicy default_retry;
+        std::map<std::string, RetryPolicy> retry_overrides;
+
+        // Hedging: if an attempt has not answered within the given percentile
+        // of recent latencies on its route, a second identical request races it
+        bool hedging = false;
+        double hedge_percentile = 0.95;
+        std::chrono::milliseconds min_hedge_delay{50};
+        std::vector<int64_t> latencies[Metrics::RouteCount];
+        size_t next_latency[Metrics::RouteCount] = {};
+
+        std::atomic<uint64_t> retries{0};
+        std::atomic<uint64_t> hedges{0};
+        std::atomic<uint64_t> throttled{0};
+
+        // Takes a token and returns how long to wait before using it
+        std::chrono::milliseconds reserve() {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto now = std::chrono::steady_clock::now();
+            auto pause = std::chrono::duration<double>(paused_until - now).count();
+            if (max_rate <= 0) return std::chrono::milliseconds(static_cast<int64_t>(std::max(0.0, pause) * 1000));
+            tokens = std::min(burst, tokens + std::chrono::duration<double>(now - refilled).count() * rate);
+            refilled = now;
+            tokens -= 1;
+            double wait = tokens < 0 ? -tokens / rate : 0;
+            return std::chrono::milliseconds(static_cast<int64_t>(std::max(wait, pause) * 1000));
+        }
+
+        void on_throttled(std::chrono::milliseconds retry_after) {
+            ++throttled;
+            std::lock_guard<std::mutex> lock(mutex);
+            paused_until = std::max(paused_until, std::chrono::steady_clock::now() + retry_after);
+            if (max_rate <= 0) return;
+            rate = std::max(max_rate / 10, rate / 2);
+            tokens = std::min(tokens, 0.0);
+        }
+
+        void on_success() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (max_rate > 0 && rate < max_rate) rate = std::min(max_rate, rate + max_rate / 20);
+        }
+
+        RetryPolicy retry_policy_for(const std::string& endpoint) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string path = endpoint.substr(0, endpoint.find('?'));
+            RetryPolicy policy = default_retry;
+            size_t matched = 0;
+            for (const auto& rule : retry_overrides) {
+                if (rule.first.size() >= matched && path.compare(0, rule.first.size(), rule.first) == 0) {
+                    policy = rule.second;
+                    matched = rule.first.size();
+                }
+            }
+            return policy;
+        }
+
+        // Exports vary too much in size for their latencies to predict each other
+        static bool hedgeable(Metrics::Route route) {
+            return route != Metrics::CatalogExports && route != Metrics::DatasetExports;
+        }
+
+        void record_latency(Metrics::Route route, std::chrono::steady_clock::duration elapsed) {
+            if (!hedgeable(route)) return;
+            std::lock_guard<std::mutex> lock(mutex);
+            int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+            auto& samples = latencies[route];
+            if (samples.size() < 256) {
+                samples.push_back(ms);
+            } else {
+                samples[next_latency[route]] = ms;
+                next_latency[route] = (next_latency[route] + 1) % samples.size();
+            }
+        }
+
+        // Zero when hedging is off or the route has too few samples yet
+        std::chrono::milliseconds hedge_delay(Metrics::Route route) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!hedging || latencies[route].size() < 20) return std::chrono::milliseconds(0);
+            std::vector<int64_t> sorted(latencies[route]);
+            size_t index = std::min(sorted.size() - 1, static_cast<size_t>(hedge_percentile * sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+            return std::max(min_hedge_delay, std::chrono::milliseconds(sorted[index]));
+        }
+
+        std::chrono::milliseconds backoff(const RetryPolicy& policy, int attempt) {
+            static thread_local std::mt19937_64 random(std::random_device{}());
+            double cap = std::min<double>(static_cast<double>(policy.max_delay.count()),
+                                          static_cast<double>(policy.base_delay.count()) * std::pow(2.0, attempt - 1));
+            std::uniform_real_distribution<double> jitter(0, cap);
+            return std::chrono::milliseconds(static_cast<int64_t>(jitter(random)));
+        }
+    };
+
+    std::shared_ptr<RequestControl> control = std::make_shared<RequestControl>();
+
+    typedef std::function<http_request()> RequestFactory;
+
+    // Completes after duration, or as soon as token is cancelled; callers
+    // check the token afterwards.
+    static pplx::task<void> delay(std::chrono::milliseconds duration,
+                                  const pplx::cancellation_token& token = pplx::cancellation_token::none()) {
+        if (duration.count() <= 0 || token.is_canceled()) return pplx::task_from_result();
+#if !defined(_WIN32)
+        pplx::task_completion_event<void> elapsed;
+        auto registration = std::make_shared<pplx::cancellation_token_registration>();
+        auto timer = std::make_shared<boost::asio::steady_timer>(crossplat::threadpool::shared_instance().service(), duration);
+        if (token.is_cancelable()) {
+            // Canceling also removes the wait from the timer queue
+            std::weak_ptr<boost::asio::steady_timer> pending = timer;
+            *registration = token.register_callback([elapsed, pending]() {
+                elapsed.set();
+                if (auto timer = pending.lock()) timer->cancel();
+            });
+        }
+        timer->async_wait([timer, elapsed, token, registration](const boost::system::error_code&) {
+            if (token.is_cancelable()) token.deregister_callback(*registration);
+            elapsed.set();
+        });
+        return pplx::create_task(elapsed);
+#else
+        // No asio pool to time on here, so the wait holds a pool thread;
+        // cancelling the token wakes it at once.
+        struct Sleeper {
+            std::mutex mutex;
+            std::condition_variable woken;
+            bool canceled = false;
+        };
+        auto sleeper = std::make_shared<Sleeper>();
+        pplx::cancellation_token_registration registration;
+        if (token.is_cancelable()) {
+            registration = token.register_callback([sleeper]() {
+                std::lock_guard<std::mutex> lock(sleeper->mutex);
+                sleeper->canceled = true;
+                sleeper->woken.notify_all();
+            });
+        }
+        return pplx::create_task([sleeper, duration, token, registration]() {
+            {
+                std::unique_lock<std::mutex> lock(sleeper->mutex);
+                sleeper->woken.wait_for(lock, duration, [&sleeper]() { return sleeper->canceled; });
+            }
+            if (token.is_cancelable()) token.deregister_callback(registration);
+        });
+#endif
+    }
+
+    static pplx::cancellation_token_source linked_source(pplx::cancellation_token token) {
+        if (!token.is_cancelable()) return pplx::cancellation_token_source();
+        return pplx::cancellation_token_source::create_linked_source(token);
+    }
+
+    static void throw_if_canceled(const pplx::cancellation_token& token) {
+        if (token.is_canceled()) throw pplx::task_canceled();
+    }
+
+    // Cancellation state of one call with CallOptions: a source linked to
+    // the caller's token that a deadline timer also cancels. The timer only
+    // holds a weak reference, and close() stops it once the call finishes.
+    struct CallScope {
+        pplx::cancellation_token_source source;
+        pplx::cancellation_token_source deadline;
+        std::atomic<bool> expired{false};
+
+        pplx::cancellation_token token() const { return source.get_token(); }
+
+        json::value error() const {
+            return make_error(expired ? U("Deadline exceeded") : U("Request canceled"));
+        }
+
+        static std::shared_ptr<CallScope> open(const CallOptions& options) {
+            if (options.empty()) return nullptr;
+            auto scope = std::make_shared<CallScope>();
+            scope->source = linked_source(options.token);
+            if (options.timeout.count() > 0) {
+                std::weak_ptr<CallScope> weak = scope;
+                auto timer = scope->deadline.get_token();
+                delay(options.timeout, timer).then([weak, timer]() {
+                    auto scope = weak.lock();
+                    if (!scope || timer.is_canceled() || scope->token().is_canceled()) return;
+                    scope->expired = true;
+                    scope->source.cancel();
+                });
+            }
+            return scope;
+        }
+
+        // Called once the call has finished, so its deadline timer does not
+        // stay queued until it expires
+        void close() {
+            deadline.cancel();
+        }
+
+        static void close(const std::shared_ptr<CallScope>& scope) {
+            if (scope) scope->close();
+        }
+
+        static pplx::cancellation_token token_of(const std::shared_ptr<CallScope>& scope) {
+            return scope ? scope->token() : pplx::cancellation_token::none();
+        }
+    };
+
+    static bool is_retriable(status_code status) {
+        return status == status_codes::RequestTimeout || status == status_codes::TooManyRequests ||
+               status == status_codes::InternalError || status == status_codes::BadGateway ||
+               status == status_codes::ServiceUnavailable || status == status_codes::GatewayTimeout;
+    }
+
+    // Retry-After in its delta-seconds form, at most limit; HTTP dates are
+    // ignored
+    static std::chrono::milliseconds retry_after(const http_response& response, std::chrono::milliseconds limit) {
+        auto value = utility::conversions::to_utf8string(header_value(response, U("Retry-After")));
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) return std::chrono::milliseconds(0);
+        int64_t seconds = 0;
+        for (char digit : value) {
+            seconds = seconds * 10 + (digit - '0');
+            if (seconds > limit.count() / 1000) return limit;
+        }
+        return std::min(limit, std::chrono::milliseconds(seconds * 1000));
+    }
+
+    static pplx::task<http_response> timed_request(const std::shared_ptr<ConnectionPool>& pool,
+                                                   const std::shared_ptr<RequestControl>& control,
+                                                   const std::shared_ptr<EndpointStats>& stats,
+                                                   Metrics::Route route,
+                                                   const http_request& request,
+                                                   const pplx::cancellation_token& token) {
+        auto started = std::chrono::steady_clock::now();
+        if (stats) stats->attempts.fetch_add(1, std::memory_order_relaxed);
+        return pool->client->request(request, token).then([control, stats, route, started](pplx::task<http_response> attempt) {
+            http_response response;
+            try {
+                response = attempt.get();
+            } catch (...) {
+                if (stats) stats->record_status(0);
+                throw;
+            }
+            auto elapsed = std::chrono::steady_clock::now() - started;
+            if (response.status_code() < 500) control->record_latency(route, elapsed);
+            if (stats) {
+                stats->ttfb.record(elapsed);
+                stats->record_status(response.status_code());
+            }
+            return response;
+        });
+    }
+
+    // Races a second request against the first one once hedge_after has
+    // passed without a response; the loser is cancelled. Only when every
+    // started attempt has failed does the race fail. The second request
+    // holds a connection slot of its own; whichever leg does not deliver
+    // the result gives one slot back when it ends.
+    struct HedgeRace {
+        std::shared_ptr<ConnectionPool> pool;
+        pplx::task_completion_event<http_response> winner;
+        pplx::cancellation_token_source first;
+        pplx::cancellation_token_source second;
+        std::mutex mutex;
+        int running = 1;
+        bool settled = false;
+
+        HedgeRace(const std::shared_ptr<ConnectionPool>& p, const pplx::cancellation_token& token)
+            : pool(p), first(linked_source(token)), second(linked_source(token)) {}
+
+        void finish(pplx::task<http_response> attempt, bool is_first) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (settled) {
+                // The loser of a two-leg race
+                lock.unlock();
+                pool->release();
+                return;
+            }
+            try {
+                auto response = attempt.get();
+                settled = true;
+                lock.unlock();
+                winner.set(response);
+                (is_first ? second : first).cancel();
+            } catch (...) {
+                if (--running == 0) {
+                    settled = true;
+                    lock.unlock();
+                    winner.set_exception(std::current_exception());
+                } else {
+                    // The other leg still holds a slot
+                    lock.unlock();
+                    pool->release();
+                }
+            }
+        }
+    };
+
+    // One attempt: waits for a rate-limit token, then for a connection slot,
+    // and sends the request, hedged if hedge is set. A successful response
+    // still holds the slot, which the caller releases once the body has been
+    // read; a failed attempt has already released it.
+    static pplx::task<http_response> send_attempt(const std::shared_ptr<ConnectionPool>& pool,
+                                                  const std::shared_ptr<RequestControl>& control,
+                                                  const std::shared_ptr<EndpointStats>& stats,
+                                                  const RequestFactory& make_request,
+                                                  Metrics::Route route,
+                                                  bool hedge,
+                                                  const pplx::cancellation_token& token) {
+        return delay(control->reserve(), token).then([pool, control, stats, make_request, route, hedge, token]() {
+            throw_if_canceled(token);
+            auto queued = std::chrono::steady_clock::now();
+            auto holds_slot = std::make_shared<bool>(false);
+            return pool->acquire(token)
+                .then([pool, control, stats, make_request, route, hedge, token, queued, holds_slot]() {
+                    *holds_slot = true;
+                    throw_if_canceled(token);
+                    if (stats) stats->queue.record(std::chrono::steady_clock::now() - queued);
+                    return send_hedged(pool, control, stats, make_request, route, hedge, token);
+                })
+                .then([pool, holds_slot](pplx::task<http_response> attempt) {
+                    try {
+                        return attempt.get();
+                    } catch (...) {
+                        if (*holds_slot) pool->release();
+                        throw;
+                    }
+                });
+        });
+    }
+
+    static pplx::task<http_response> send_hedged(const std::shared_ptr<ConnectionPool>& pool,
+                                                 const std::shared_ptr<RequestControl>& control,
+                                                 const std::shared_ptr<EndpointStats>& stats,
+                                                 const RequestFactory& make_request,
+                                                 Metrics::Route route,
+                                                 bool hedge,
+                                                 const pplx::cancellation_token& token) {
+        auto hedge_after = hedge ? control->hedge_delay(route) : std::chrono::milliseconds(0);
+        if (hedge_after.count() == 0) {
+            return timed_request(pool, control, stats, route, make_request(), token);
+        }
+
+        // The hedge needs a free slot of its own, so hedging never puts more
+        // than max_connections requests in flight; with none free it is skipped
+        auto race = std::make_shared<HedgeRace>(pool, token);
+        timed_request(pool, control, stats, route, make_request(), race->first.get_token())
+            .then([race](pplx::task<http_response> attempt) { race->finish(attempt, true); });
+        delay(hedge_after, token).then([pool, control, stats, make_request, route, race, token]() {
+            {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                if (race->settled || token.is_canceled() || !pool->try_acquire()) return;
+                ++race->running;
+            }
+            ++control->hedges;
+            timed_request(pool, control, stats, route, make_request(), race->second.get_token())
+                .then([race](pplx::task<http_response> attempt) { race->finish(attempt, false); });
+        });
+        return pplx::create_task(race->winner);
+    }
+
+    // Retries hold no connection slot while they back off
+    static pplx::task<http_response> send_with_retry(const std::shared_ptr<ConnectionPool>& pool,
+                                                     const std::shared_ptr<RequestControl>& control,
+                                                     const std::shared_ptr<EndpointStats>& stats,
+                                                     const RequestFactory& make_request,
+                                                     const RetryPolicy& policy,
+                                                     Metrics::Route route,
+                                                     bool hedge,
+                                                     const pplx::cancellation_token& token,
+                                                     int attempt) {
+        return send_attempt(pool, control, stats, make_request, route, hedge, token)
+            .then([pool, control, stats, make_request, policy, route, hedge, token, attempt](pplx::task<http_response> previousTask) {
+                http_response response;
+                std::chrono::milliseconds wait(0);
+                bool holds_slot = false;
+                try {
+                    response = previousTask.get();
+                    holds_slot = true;
+                    wait = retry_after(response, policy.max_delay);
+                    if (response.status_code() == status_codes::TooManyRequests) {
+                        control->on_throttled(wait);
+                    } else if (response.status_code() < 500) {
+                        control->on_success();
+                    }
+                    if (!is_retriable(response.status_code()) || attempt >= policy.max_attempts || token.is_canceled()) {
+                        return pplx::task_from_result(response);
+                    }
+                    holds_slot = false;
+                    pool->release();
+                } catch (const std::exception&) {
+                    if (holds_slot) pool->release();
+                    if (attempt >= policy.max_attempts) throw;
+                    throw_if_canceled(token);
+                }
+                ++control->retries;
+                wait = std::min(policy.max_delay, std::max(wait, control->backoff(policy, attempt)));
+                return delay(wait, token).then([pool, control, stats, make_request, policy, route, hedge, token, attempt]() {
+                    throw_if_canceled(token);
+                    return send_with_retry(pool, control, stats, make_request, policy, route, hedge, token, attempt + 1);
+                });
+            });
+    }
+
+    // Returns a callable that sends endpoint with rate limiting, retries
+    // (GET only) and hedging (GET only, never for exports or when
+    // allow_hedge is false) applied, all of which stop once token is
+    // cancelled. The response it resolves to holds a connection slot that
+    // the caller must release. It holds no reference to the API object.
+    std::function<pplx::task<http_response>()> prepare_send(
+        const std::string& endpoint,
+        const std::string& method,
+        const std::vector<std::pair<utility::string_t, utility::string_t>>& extra_headers =
+            std::vector<std::pair<utility::string_t, utility::string_t>>(),
+        const pplx::cancellation_token& token = pplx::cancellation_token::none(),
+        bool allow_hedge = true) {
+        auto pool = this->pool;
+        auto control = this->control;
+        auto stats = Metrics::stats_for(current_metrics(), endpoint);
+        auto route = Metrics::route_of(endpoint);
+        bool idempotent = method == "GET";
+        bool hedge = idempotent && allow_hedge && RequestControl::hedgeable(route);
+        RetryPolicy policy = idempotent ? control->retry_policy_for(endpoint) : RetryPolicy(1);
+        auto host = this->host;
+        RequestFactory make_request = [endpoint, method, host, extra_headers]() {
+            auto request = create_request(endpoint, method, host);
+            for (const auto& header : extra_headers) request.headers().add(header.first, header.second);
+            return request;
+        };
+        return [pool, control, stats, make_request, policy, route, hedge, token]() {
+            return send_with_retry(pool, control, stats, make_request, policy, route, hedge, token, 1);
+        };
+    }
+
+    // use_cache = false skips the response cache and coalescing, for
+    // callers that need the server's current answer
+    pplx::task<json::value> make_api_call(const std::string& endpoint, const std::string& method,
+                                          const CallOptions& options = CallOptions(), bool use_cache = true) {
+        // A shared flight cannot honour one caller's cancellation or deadline
+        if (method != "GET" || !coalesce_requests || !options.empty() || !use_cache) {
+            return send_api_call(endpoint, method, options, use_cache);
+        }
+
+        auto flights = in_flight_calls;
+        std::string key = method + " " + endpoint;
+        pplx::task_completion_event<json::value> done;
+        pplx::task<json::value> flight(done);
+        {
+            std::lock_guard<std::mutex> lock(flights->mutex);
+            auto it = flights->calls.find(key);
+            if (it != flights->calls.end()) {
+                ++flights->coalesced;
+                if (auto stats = Metrics::stats_for(current_metrics(), endpoint)) {
+                    stats->coalesced.fetch_add(1, std::memory_order_relaxed);
+                }
+                return it->second;
+            }
+            flights->calls[key] = flight;
+        }
+
+        send_api_call(endpoint, method).then([flights, key, done](pplx::task<json::value> previousTask) {
+            {
+                std::lock_guard<std::mutex> lock(flights->mutex);
+                flights->calls.erase(key);
+            }
+            try {
+                done.set(previousTask.get());
+            } catch (...) {
+                done.set_exception(std::current_exception());
+            }
+        });
+        return flight;
+    }
+
+    pplx::task<json::value> send_api_call(const std::string& endpoint, const std::string& method,
+                                          const CallOptions& options = CallOptions(), bool use_cache = true) {
+        auto pool = this->pool;
+        auto call = start_call(endpoint);
+        auto scope = CallScope::open(options);
+
+        // GET responses are cached when a cache is enabled and the endpoint's
+        // TTL is positive. Keys include the base URL, so clients of different
+        // portals can share a cache directory.
+        auto cache = method == "GET" && use_cache ? this->cache : nullptr;
+        std::string cache_key;
+        std::chrono::seconds ttl(0);
+        std::shared_ptr<const CacheEntry> cached;
+        if (cache) {
+            ttl = cache->ttl_for(endpoint);
+            if (ttl.count() > 0) {
+                cache_key = api_base + endpoint;
+                cached = cache->lookup(cache_key);
+            } else {
+                cache.reset();
+            }
+        }
+        if (cached) {
+            if (std::chrono::system_clock::now() < cached->expires) {
+                ++cache->hits;
+                if (call) {
+                    call->stats->cache_hits.fetch_add(1, std::memory_order_relaxed);
+                    call->finished(0);
+                }
+                CallScope::close(scope);
+                return pplx::task_from_result(cached->body);
+            }
+        }
+
+        std::vector<std::pair<utility::string_t, utility::string_t>> validators;
+        if (cached && !cached->etag.empty()) validators.push_back(std::make_pair(U("If-None-Match"), cached->etag));
+        if (cached && !cached->last_modified.empty()) validators.push_back(std::make_pair(U("If-Modified-Since"), cached->last_modified));
+        auto send = prepare_send(endpoint, method, validators, CallScope::token_of(scope));
+        auto holds_slot = std::make_shared<bool>(false);
+
+        return send()
+            .then([cache, cached, cache_key, ttl, call, holds_slot](http_response response) {
+                *holds_slot = true;
+                if (call) call->received();
+                if (cached && response.status_code() == status_codes::NotModified) {
+                    cache->revalidate(cache_key, *cached, ttl);
+                    if (call) call->stats->cache_revalidations.fetch_add(1, std::memory_order_relaxed);
+                    return pplx::task_from_result(cached->body);
+                }
                 if (response.status_code() == status_codes::OK) {
-                    return response.extract_json();
+                    // A body announced as larger than the budget is not cached
+                    auto store = cache && response.headers().content_length() <= cache->memory_budget ? cache : nullptr;
+                    if (store) {
+                        ++store->misses;
+                        if (call) call->stats->cache_misses.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    auto etag = header_value(response, U("ETag"));
+                    auto last_modified = header_value(response, U("Last-Modified"));
+                    // Read as bytes so chunked bodies, which carry no
+                    // Content-Length, are counted too
+                    return response.extract_vector().then(
+                        [store, cache_key, ttl, etag, last_modified, call](std::vector<unsigned char> bytes) {
+                            if (call) call->stats->response_bytes.fetch_add(bytes.size(), std::memory_order_relaxed);
+                            auto body = json::value::parse(
+                                utility::conversions::to_string_t(std::string(bytes.begin(), bytes.end())));
+                            if (store) store->store(cache_key, body, etag, last_modified, ttl);
+                            return body;
+                        });
                 } else {
-                    json::value error_obj;
-                    error_obj[U("error")] = json::value::string(
+                    return pplx::task_from_result(make_error(
+                        U("HTTP Error: ") + utility::conversions::to_string_t(std::to_string(response.status_code()))));
+                }
+            })
+            .then([pool, call, scope, holds_slot](pplx::task<json::value> previousTask) {
+                if (*holds_slot) pool->release();
+                if (call) call->finished(0);
+                CallScope::close(scope);
+                try {
+                    return previousTask.get();
+                } catch (const pplx::task_canceled&) {
+                    return scope ? scope->error() : make_error(U("Request canceled"));
+                } catch (const std::exception& e) {
+                    return make_error(U("Exception: ") + utility::conversions::to_string_t(e.what()));
+                }
+            });
+    }
+
+    // Fetches a /records or /exports/json body as raw bytes and decodes it
+    // into a RecordBatch. Bypasses the JSON response cache and coalescing.
+    pplx::task<std::shared_ptr<RecordBatch>> decode_api_call(const std::string& endpoint, const RecordSchema& schema,
+                                                             const CallOptions& options = CallOptions()) {
+        auto scope = CallScope::open(options);
+        auto send = prepare_send(endpoint, "GET", std::vector<std::pair<utility::string_t, utility::string_t>>(),
+                                 CallScope::token_of(scope));
+        auto pool = this->pool;
+        auto shared_schema = std::make_shared<RecordSchema>(schema);
+        auto call = start_call(endpoint);
+        auto holds_slot = std::make_shared<bool>(false);
+
+        return send()
+            .then([shared_schema, call, holds_slot](http_response response) {
+                *holds_slot = true;
+                if (call) call->received();
+                if (response.status_code() != status_codes::OK) {
+                    auto batch = std::make_shared<RecordBatch>(*shared_schema);
+                    batch->error = make_error(
                         U("HTTP Error: ") + utility::conversions::to_string_t(std::to_string(response.status_code())));
-                    error_obj[U("success")] = json::value::boolean(false);
-                    return pplx::task_from_result(error_obj);
+                    return pplx::task_from_result(batch);
                 }
+                return response.extract_vector().then([shared_schema, call](std::vector<unsigned char> body) {
+                    if (call) call->stats->response_bytes.fetch_add(body.size(), std::memory_order_relaxed);
+                    auto batch = std::make_shared<RecordBatch>(*shared_schema);
+                    RecordBatchDecoder decoder(*shared_schema);
+                    std::string error;
+                    if (!decoder.decode_response(reinterpret_cast<const char*>(body.data()), body.size(), *batch, &error)) {
+                        batch->error = make_error(U("Decode error: ") + utility::conversions::to_string_t(error));
+                    }
+                    return batch;
+                });
             })
-            .then([](pplx::task<json::value> previousTask) {
+            .then([pool, shared_schema, call, scope, holds_slot](pplx::task<std::shared_ptr<RecordBatch>> previousTask) {
+                if (*holds_slot) pool->release();
+                if (call) call->finished(0);
+                CallScope::close(scope);
                 try {
                     return previousTask.get();
+                } catch (const pplx::task_canceled&) {
+                    auto batch = std::make_shared<RecordBatch>(*shared_schema);
+                    batch->error = scope ? scope->error() : make_error(U("Request canceled"));
+                    return batch;
                 } catch (const std::exception& e) {
-                    json::value error_obj;
-                    error_obj[U("error")] = json::value::string(
-                        U("Exception: ") + utility::conversions::to_string_t(e.what()));
-                    error_obj[U("success")] = json::value::boolean(false);
-                    return error_obj;
+                    auto batch = std::make_shared<RecordBatch>(*shared_schema);
+                    batch->error = make_error(U("Exception: ") + utility::conversions::to_string_t(e.what()));
+                    return batch;
                 }
             });
     }
 
+    // Moves a response body into an ExportSink through one fixed-size
+    // buffer, optionally gunzipping it on the way.
+    struct StreamState {
+        ExportSink sink;
+        std::vector<uint8_t> buffer;
+        std::vector<uint8_t> inflated;
+        std::unique_ptr<web::http::compression::decompress_provider> decompressor;
+        uint64_t bytes_received = 0;
+        uint64_t bytes_written = 0;
+        pplx::cancellation_token token = pplx::cancellation_token::none();
+
+        StreamState(const ExportSink& s, bool gunzip) : sink(s), buffer(64 * 1024) {
+            if (gunzip) {
+                decompressor = web::http::compression::builtin::make_decompressor(web::http::compression::builtin::algorithm::GZIP);
+                if (!decompressor) throw std::runtime_error("gzip decompression is not supported by this cpprest build");
+                inflated.resize(buffer.size() * 4);
+            }
+        }
+
+        void write(const uint8_t* data, size_t size, bool last) {
+            bytes_received += size;
+            if (!decompressor) {
+                if (size == 0) return;
+                sink(reinterpret_cast<const char*>(data), size);
+                bytes_written += size;
+                return;
+            }
+
+            size_t consumed = 0;
+            bool done = false;
+            while (!done && (consumed < size || last)) {
+                size_t used = 0;
+                size_t produced = decompressor->decompress(
+                    data + consumed, size - consumed, inflated.data(), inflated.size(),
+                    last ? web::http::compression::operation_hint::is_last : web::http::compression::operation_hint::has_more,
+                    used, done);
+                consumed += used;
+                if (produced > 0) {
+                    sink(reinterpret_cast<const char*>(inflated.data()), produced);
+                    bytes_written += produced;
+                }
+                if (used == 0 && produced == 0) break;
+            }
+        }
+    };
+
+    static pplx::task<void> pump_body(concurrency::streams::istream body, std::shared_ptr<StreamState> state) {
+        return body.streambuf().getn(state->buffer.data(), state->buffer.size())
+            .then([body, state](size_t read) {
+                throw_if_canceled(state->token);
+                if (read == 0) {
+                    state->write(nullptr, 0, true);
+                    return pplx::task_from_result();
+                }
+                state->write(state->buffer.data(), read, false);
+                return pump_body(body, state);
+            });
+    }
+
+    pplx::task<json::value> stream_api_call(const std::string& endpoint, const ExportSink& sink, bool gunzip,
+                                            const CallOptions& options = CallOptions()) {
+        std::shared_ptr<StreamState> state;
+        try {
+            state = std::make_shared<StreamState>(sink, gunzip);
+        } catch (const std::exception& e) {
+            return pplx::task_from_result(make_error(U("Exception: ") + utility::conversions::to_string_t(e.what())));
+        }
+
+        auto scope = CallScope::open(options);
+        state->token = CallScope::token_of(scope);
+        auto send = prepare_send(endpoint, "GET", std::vector<std::pair<utility::string_t, utility::string_t>>(), state->token, false);
+        auto pool = this->pool;
+        auto call = start_call(endpoint);
+        auto holds_slot = std::make_shared<bool>(false);
+
+        return send()
+            .then([state, call, holds_slot](http_response response) {
+                *holds_slot = true;
+                if (call) call->received();
+                if (response.status_code() != status_codes::OK) {
+                    return pplx::task_from_result(make_error(
+                        U("HTTP Error: ") + utility::conversions::to_string_t(std::to_string(response.status_code()))));
+                }
+                return pump_body(response.body(), state).then([state]() {
+                    json::value result;
+                    result[U("success")] = json::value::boolean(true);
+                    result[U("bytes_received")] = json::value::number(state->bytes_received);
+                    result[U("bytes_written")] = json::value::number(state->bytes_written);
+                    return result;
+                });
+            })
+            .then([pool, state, call, scope, holds_slot](pplx::task<json::value> previousTask) {
+                if (*holds_slot) pool->release();
+                if (call) call->finished(state->bytes_received);
+                CallScope::close(scope);
+                try {
+                    return previousTask.get();
+                } catch (const pplx::task_canceled&) {
+                    return scope ? scope->error() : make_error(U("Request canceled"));
+                } catch (const std::exception& e) {
+                    return make_error(U("Exception: ") + utility::conversions::to_string_t(e.what()));
+                }
+            });
+    }
+
+    // Shared state of one bulk_fetch_dataset run. Partitions are fetched with
+    // at most max_in_flight of them ahead of the oldest undelivered one, so
+    // buffered results stay bounded, and are delivered to the sink in order.
+    // A failed partition is fetched again after the retry policy's backoff.
+    struct BulkFetch {
+        std::vector<std::function<pplx::task<json::value>()>> partitions;
+        RecordSink sink;
+        ProgressCallback progress;
+        size_t max_in_flight;
+        int max_retries;
+        std::shared_ptr<RequestControl> control;
+        RetryPolicy policy;
+        pplx::cancellation_token token = pplx::cancellation_token::none();
+
+        std::mutex mutex;
+        size_t next_to_start = 0;
+        size_t next_to_deliver = 0;
+        std::vector<std::unique_ptr<std::vector<json::value>>> ready;
+        std::vector<bool> done;
+        uint64_t records_delivered = 0;
+        json::value failures = json::value::array();
+        bool delivering = false;
+        bool aborted = false;
+        pplx::task_completion_event<json::value> finished;
+
+        void launch(const std::shared_ptr<BulkFetch>& self) {
+            std::vector<size_t> to_start;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (!aborted && next_to_start < partitions.size() &&
+                       next_to_start - next_to_deliver < max_in_flight) {
+                    to_start.push_back(next_to_start++);
+                }
+            }
+            for (size_t index : to_start) fetch(self, index, 0);
+        }
+
+        static void fetch(const std::shared_ptr<BulkFetch>& self, size_t index, int attempt) {
+            self->partitions[index]()
+                .then([self, index, attempt](json::value result) {
+                    bool failed = result.is_object() && result.has_field(U("error"));
+                    if (failed && attempt < self->max_retries && !self->token.is_canceled()) {
+                        delay(self->control->backoff(self->policy, attempt + 1), self->token).then([self, index, attempt]() {
+                            fetch(self, index, attempt + 1);
+                        });
+                        return;
+                    }
+                    self->complete(self, index, result, failed);
+                });
+        }
+
+        void complete(const std::shared_ptr<BulkFetch>& self, size_t index, const json::value& result, bool failed) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (aborted) return;
+
+                std::unique_ptr<std::vector<json::value>> records(new std::vector<json::value>());
+                if (failed) {
+                    json::value failure;
+                    failure[U("partition")] = json::value::number(static_cast<uint64_t>(index));
+                    failure[U("error")] = result.at(U("error"));
+                    failures[failures.size()] = failure;
+                } else if (result.is_array()) {
+                    records->assign(result.as_array().begin(), result.as_array().end());
+                } else if (result.has_field(U("results"))) {
+                    const auto& results = result.at(U("results")).as_array();
+                    records->assign(results.begin(), results.end());
+                }
+                ready[index] = std::move(records);
+                done[index] = true;
+
+                // The thread already delivering picks this partition up
+                if (delivering) return;
+                delivering = true;
+            }
+            deliver(self);
+        }
+
+        // Hands finished partitions to the sink in order. One thread delivers
+        // at a time and calls sink and progress without holding the mutex, so
+        // they may block or call back into the API.
+        void deliver(const std::shared_ptr<BulkFetch>& self) {
+            json::value summary;
+            for (;;) {
+                std::unique_ptr<std::vector<json::value>> records;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (next_to_deliver == partitions.size() || !done[next_to_deliver]) {
+                        delivering = false;
+                        if (next_to_deliver < partitions.size()) return;
+                        summary[U("success")] = json::value::boolean(failures.size() == 0);
+                        if (failures.size() > 0) {
+                            summary[U("error")] = json::value::string(utility::conversions::to_string_t(
+                                std::to_string(failures.size()) + " of " + std::to_string(partitions.size()) + " partitions failed"));
+                        }
+                        summary[U("partitions")] = json::value::number(static_cast<uint64_t>(partitions.size()));
+                        summary[U("records")] = json::value::number(records_delivered);
+                        summary[U("failed_partitions")] = failures;
+                        break;
+                    }
+                    records = std::move(ready[next_to_deliver]);
+                }
+
+                try {
+                    for (const auto& record : *records) sink(record);
+                    size_t delivered;
+                    uint64_t total;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        records_delivered += records->size();
+                        delivered = ++next_to_deliver;
+                        total = records_delivered;
+                    }
+                    if (progress) progress(delivered, partitions.size(), total);
+                } catch (const std::exception& e) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        aborted = true;
+                        delivering = false;
+                    }
+                    finished.set(make_error(U("Exception: ") + utility::conversions::to_string_t(e.what())));
+                    return;
+                }
+                launch(self);
+            }
+            finished.set(summary);
+        }
+    };
+
+    // Orders two JSON scalars: numerically for numbers, lexically otherwise
+    // (ISO 8601 timestamps in one timezone sort correctly as text)
+    static bool json_less(const json::value& a, const json::value& b) {
+        if (a.is_number() && b.is_number()) return a.as_double() < b.as_double();
+        if (a.is_string() && b.is_string()) return a.as_string() < b.as_string();
+        return a.serialize() < b.serialize();
+    }
+
+    // The dataset's modified and data_processed metadata, or "" when it
+    // has neither, in which case sync_dataset refreshes on every run
+    static std::string dataset_stamp(const json::value& info) {
+        if (!info.has_field(U("metas")) || !info.at(U("metas")).has_field(U("default"))) return "";
+        const auto& metas = info.at(U("metas")).at(U("default"));
+        std::string stamp;
+        bool found = false;
+        for (const auto& name : {U("modified"), U("data_processed")}) {
+            if (metas.has_field(name) && metas.at(name).is_string()) {
+                stamp += utility::conversions::to_utf8string(metas.at(name).as_string());
+                found = true;
+            }
+            stamp += "|";
+        }
+        return found ? stamp : "";
+    }
+
+    // Whether dataset_id can name files in a snapshot directory
+    static bool is_safe_file_name(const std::string& dataset_id) {
+        return !dataset_id.empty() && dataset_id.find_first_of("/\\") == std::string::npos &&
+               dataset_id.find("..") == std::string::npos;
+    }
+
+    // Whether a select list is * or names field as one of its plain entries
+    static bool selects_field(const std::string& select, const std::string& field) {
+        size_t start = 0;
+        while (start <= select.size()) {
+            size_t comma = select.find(',', start);
+            if (comma == std::string::npos) comma = select.size();
+            std::string entry = select.substr(start, comma - start);
+            size_t first = entry.find_first_not_of(' ');
+            if (first != std::string::npos) {
+                entry = entry.substr(first, entry.find_last_not_of(' ') - first + 1);
+                if (entry == "*" || entry == field) return true;
+            }
+            start = comma + 1;
+        }
+        return false;
+    }
+
+    static std::string and_where(const std::string& where, const std::string& predicate) {
+        return where.empty() ? predicate : "(" + where + ") AND " + predicate;
+    }
+
+    // Runs independent calls with at most max_in_flight outstanding and
+    // collects their results by index. A failed call leaves its error object
+    // in its slot; the batch itself always completes.
+    struct BatchCall {
+        std::vector<std::function<pplx::task<json::value>()>> calls;
+        size_t max_in_flight;
+
+        std::mutex mutex;
+        size_t next_to_start = 0;
+        size_t in_flight = 0;
+        size_t completed = 0;
+        size_t failed = 0;
+        std::vector<json::value> results;
+        pplx::task_completion_event<json::value> finished;
+
+        void launch(const std::shared_ptr<BatchCall>& self) {
+            std::vector<size_t> to_start;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (next_to_start < calls.size() && in_flight < max_in_flight) {
+                    to_start.push_back(next_to_start++);
+                    ++in_flight;
+                }
+            }
+            for (size_t index : to_start) {
+                calls[index]().then([self, index](pplx::task<json::value> previousTask) {
+                    json::value result;
+                    try {
+                        result = previousTask.get();
+                    } catch (const std::exception& e) {
+                        result = make_error(U("Exception: ") + utility::conversions::to_string_t(e.what()));
+                    }
+                    self->complete(self, index, result);
+                });
+            }
+        }
+
+        void complete(const std::shared_ptr<BatchCall>& self, size_t index, const json::value& result) {
+            bool all_done;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[index] = result;
+                if (result.is_object() && result.has_field(U("error"))) ++failed;
+                --in_flight;
+                all_done = ++completed == calls.size();
+            }
+            if (!all_done) {
+                launch(self);
+                return;
+            }
+            json::value summary;
+            summary[U("success")] = json::value::boolean(true);
+            summary[U("count")] = json::value::number(static_cast<uint64_t>(results.size()));
+            summary[U("failed")] = json::value::number(static_cast<uint64_t>(failed));
+            summary[U("results")] = json::value::array(results);
+            finished.set(summary);
+        }
+    };
+
+    static pplx::task<json::value> run_batch(const std::shared_ptr<BatchCall>& batch) {
+        batch->results.assign(batch->calls.size(), json::value::null());
+        if (batch->max_in_flight == 0) batch->max_in_flight = 1;
+        if (batch->calls.empty()) {
+            json::value summary;
+            summary[U("success")] = json::value::boolean(true);
+            summary[U("count")] = json::value::number(0);
+            summary[U("failed")] = json::value::number(0);
+            summary[U("results")] = json::value::array();
+            return pplx::task_from_result(summary);
+        }
+        batch->launch(batch);
+        return pplx::create_task(batch->finished);
+    }
+
+    static std::string record_key(const json::value& value) {
+        return value.is_string() ? utility::conversions::to_utf8string(value.as_string())
+                                 : utility::conversions::to_utf8string(value.serialize());
+    }
+
+    pplx::task<json::value> run_bulk_fetch(const std::shared_ptr<BulkFetch>& bulk) {
+        if (bulk->partitions.empty()) {
+            json::value summary;
+            summary[U("success")] = json::value::boolean(true);
+            summary[U("partitions")] = json::value::number(0);
+            summary[U("records")] = json::value::number(0);
+            summary[U("failed_partitions")] = json::value::array();
+            return pplx::task_from_result(summary);
+        }
+        bulk->ready.resize(bulk->partitions.size());
+        bulk->done.assign(bulk->partitions.size(), false);
+        bulk->launch(bulk);
+        return pplx::create_task(bulk->finished);
+    }
+
+    std::string query_dataset_records_endpoint(
+        const std::string& dataset_id,
+        const std::string& select,
+        const std::string& where,
+        const std::string& group_by,
+        const std::string& order_by,
+        int limit,
+        int offset,
+        const std::string& refine,
+        const std::string& exclude,
+        const std::string& lang,
+        const std::string& timezone,
+        bool include_links,
+        bool include_app_metas) {
+        
+        Query query;
+        
+        query.select(select);
+        query.where(where);
+        query.group_by(group_by);
+        query.order_by(order_by);
+        if (limit != 10) query.limit(limit);
+        if (offset != 0) query.offset(offset);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.lang(lang);
+        query.timezone(timezone);
+        if (include_links) query.flag("include_links", true);
+        if (include_app_metas) query.flag("include_app_metas", true);
+        
+        return query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/records");
+    }
+
+    std::string export_catalog_endpoint(
+        const std::string& format,
+        const std::string& select,
+        const std::string& where,
+        const std::string& order_by,
+        const std::string& group_by,
+        int limit,
+        int offset,
+        const std::string& refine,
+        const std::string& exclude,
+        const std::string& lang,
+        const std::string& timezone) {
+        
+        Query query;
+        
+        query.select(select);
+        query.where(where);
+        query.order_by(order_by);
+        query.group_by(group_by);
+        if (limit != -1) query.limit(limit);
+        if (offset != 0) query.offset(offset);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.lang(lang);
+        query.timezone(timezone);
+        
+        return query.endpoint("/catalog/exports/" + OpenDataSoftQuery::encode(format));
+    }
+
+    std::string export_catalog_csv_endpoint(
+        const std::string& select,
+        const std::string& where,
+        const std::string& order_by,
+        const std::string& group_by,
+        int limit,
+        int offset,
+        const std::string& refine,
+        const std::string& exclude,
+        const std::string& lang,
+        const std::string& timezone,
+        const std::string& delimiter,
+        const std::string& list_separator,
+        bool quote_all,
+        bool with_bom) {
+        
+        Query query;
+        
+        // Standard parameters
+        query.select(select);
+        query.where(where);
+        query.order_by(order_by);
+        query.group_by(group_by);
+        if (limit != -1) query.limit(limit);
+        if (offset != 0) query.offset(offset);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.lang(lang);
+        query.timezone(timezone);
+        
+        // CSV-specific parameters
+        if (delimiter != ";") query.param("delimiter", delimiter);
+        if (list_separator != ",") query.param("list_separator", list_separator);
+        if (quote_all) query.flag("quote_all", true);
+        if (!with_bom) query.flag("with_bom", false);
+        
+        return query.endpoint("/catalog/exports/csv");
+    }
+
+    std::string export_dataset_endpoint(
+        const std::string& dataset_id,
+        const std::string& format,
+        const std::string& select,
+        const std::string& where,
+        const std::string& order_by,
+        const std::string& group_by,
+        int limit,
+        const std::string& refine,
+        const std::string& exclude,
+        const std::string& lang,
+        const std::string& timezone,
+        bool use_labels,
+        bool compressed,
+        int epsg) {
+        
+        Query query;
+        
+        query.select(select);
+        query.where(where);
+        query.order_by(order_by);
+        query.group_by(group_by);
+        if (limit != -1) query.limit(limit);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.lang(lang);
+        query.timezone(timezone);
+        if (use_labels) query.flag("use_labels", true);
+        if (compressed) query.flag("compressed", true);
+        if (epsg != 4326) query.param("epsg", std::to_string(epsg));
+        
+        return query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/exports/" + OpenDataSoftQuery::encode(format));
+    }
+
+    std::string export_dataset_csv_endpoint(
+        const std::string& dataset_id,
+        const std::string& select,
+        const std::string& where,
+        const std::string& order_by,
+        const std::string& group_by,
+        int limit,
+        const std::string& refine,
+        const std::string& exclude,
+        const std::string& lang,
+        const std::string& timezone,
+        const std::string& delimiter,
+        const std::string& list_separator,
+        bool quote_all,
+        bool with_bom) {
+        
+        Query query;
+        
+        // Standard parameters
+        query.select(select);
+        query.where(where);
+        query.order_by(order_by);
+        query.group_by(group_by);
+        if (limit != -1) query.limit(limit);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.lang(lang);
+        query.timezone(timezone);
+        
+        // CSV-specific parameters
+        if (delimiter != ";") query.param("delimiter", delimiter);
+        if (list_separator != ",") query.param("list_separator", list_separator);
+        if (quote_all) query.flag("quote_all", true);
+        if (!with_bom) query.flag("with_bom", false);
+        
+        return query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/exports/csv");
+    }
+
 public:
-    OpenDataSoftAPI() {
+    explicit OpenDataSoftAPI(size_t max_connections = 8) {
         client_config.set_validate_certificates(false);
+        pool = std::make_shared<ConnectionPool>(api_base, client_config, max_connections);
+    }
+
+    // Talks to another OpenDataSoft portal, or a local stand-in such as
+    // "http://127.0.0.1:8080/api/explore/v2.1"
+    explicit OpenDataSoftAPI(const std::string& base_url, size_t max_connections = 8) : api_base(base_url) {
+        web::uri uri(utility::conversions::to_string_t(base_url));
+        host = uri.host();
+        if (!uri.is_port_default()) host += U(":") + utility::conversions::to_string_t(std::to_string(uri.port()));
+        client_config.set_validate_certificates(false);
+        pool = std::make_shared<ConnectionPool>(api_base, client_config, max_connections);
+    }
+
+    const std::string& base_url() const { return api_base; }
+
+    ConnectionStats connection_stats() const {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        ConnectionStats stats;
+        stats.estimated_opened = pool->estimated_opened.load();
+        stats.estimated_reused = pool->estimated_reused.load();
+        stats.in_flight = pool->in_flight;
+        stats.max_connections = pool->max_connections;
+        stats.retries = control->retries.load();
+        stats.hedges = control->hedges.load();
+        stats.throttled = control->throttled.load();
+        return stats;
+    }
+
+    // Retry policy for all GET calls, or for endpoints starting with
+    // endpoint_prefix (longest prefix wins). RetryPolicy(1) disables retries.
+    void set_retry_policy(const RetryPolicy& policy) {
+        std::lock_guard<std::mutex> lock(control->mutex);
+        control->default_retry = policy;
+    }
+
+    void set_retry_policy(const std::string& endpoint_prefix, const RetryPolicy& policy) {
+        std::lock_guard<std::mutex> lock(control->mutex);
+        control->retry_overrides[endpoint_prefix] = policy;
+    }
+
+    // Shared token bucket for all requests; 0 requests per second removes
+    // the limit. The effective rate backs off on 429 and recovers on success.
+    void set_rate_limit(double requests_per_second, double burst = 0) {
+        std::lock_guard<std::mutex> lock(control->mutex);
+        control->max_rate = requests_per_second > 0 ? requests_per_second : 0;
+        control->rate = control->max_rate;
+        control->burst = burst >= 1 ? burst : std::max(1.0, requests_per_second);
+        control->tokens = control->burst;
+        control->refilled = std::chrono::steady_clock::now();
+    }
+
+    // Hedged GETs: once at least 20 latencies have been observed on a route,
+    // a request slower than the given percentile of them (and than
+    // min_delay) gets a second identical request; the first response wins.
+    // The second request needs a free connection slot and is skipped when
+    // none is, so hedges count against max_connections. Exports and
+    // streamed calls are never hedged.
+    void set_hedging(bool enabled, double percentile = 0.95,
+                     std::chrono::milliseconds min_delay = std::chrono::milliseconds(50)) {
+        std::lock_guard<std::mutex> lock(control->mutex);
+        control->hedging = enabled;
+        control->hedge_percentile = std::min(1.0, std::max(0.0, percentile));
+        control->min_hedge_delay = min_delay;
+    }
+
+    // Concurrent identical GET calls (same endpoint and query string) share
+    // one request and all receive its result. Enabled by default; configure
+    // before issuing calls.
+    void set_request_coalescing(bool enabled) {
+        coalesce_requests = enabled;
+    }
+
+    uint64_t coalesced_calls() const {
+        return in_flight_calls->coalesced.load();
+    }
+
+    // Response cache for GET calls, keyed by base URL, endpoint and query string.
+    // Entries live in memory (LRU, bounded by memory_budget_bytes) and, if
+    // disk_directory names an existing directory, on disk across restarts.
+    // Expired entries are revalidated with If-None-Match/If-Modified-Since,
+    // so an unchanged response costs a 304 without a body. default_ttl
+    // applies to every endpoint except exports, which are only cached when
+    // set_cache_ttl names them; responses larger than memory_budget_bytes
+    // are never cached. sync_dataset always bypasses the cache. Configure
+    // the cache before issuing calls.
+    void enable_cache(
+        size_t memory_budget_bytes = 64 * 1024 * 1024,
+        const std::string& disk_directory = "",
+        std::chrono::seconds default_ttl = std::chrono::seconds(300)) {
+        auto new_cache = std::make_shared<ResponseCache>();
+        new_cache->memory_budget = memory_budget_bytes;
+        new_cache->directory = disk_directory;
+        new_cache->default_ttl = default_ttl;
+        if (cache) {
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            new_cache->ttls = cache->ttls;
+        }
+        cache = new_cache;
+    }
+
+    void disable_cache() {
+        cache.reset();
+    }
+
+    // TTL for endpoints starting with endpoint_prefix, e.g. "/catalog/facets".
+    // The longest matching prefix wins; a zero TTL bypasses the cache.
+    void set_cache_ttl(const std::string& endpoint_prefix, std::chrono::seconds ttl) {
+        if (!cache) enable_cache();
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        cache->ttls[endpoint_prefix] = ttl;
+    }
+
+    void clear_cache() {
+        if (cache) cache->clear();
+    }
+
+    CacheStats cache_stats() const {
+        CacheStats stats = {0, 0, 0, 0, 0, 0};
+        if (!cache) return stats;
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        stats.hits = cache->hits.load();
+        stats.misses = cache->misses.load();
+        stats.revalidations = cache->revalidations.load();
+        stats.evictions = cache->evictions.load();
+        stats.entries = cache->entries.size();
+        stats.memory_bytes = cache->memory_bytes;
+        return stats;
+    }
+
+    // Metrics are off by default. While off, calls skip all timing and
+    // counting; enabling starts from zero, disabling drops what was recorded.
+    // Both are safe while calls are in flight: a call keeps recording into
+    // the Metrics it started with.
+    void enable_metrics() {
+        std::shared_ptr<Metrics> none;
+        std::atomic_compare_exchange_strong(&metrics->current, &none, std::make_shared<Metrics>());
+        metrics->enabled.store(true, std::memory_order_release);
+    }
+
+    void disable_metrics() {
+        metrics->enabled.store(false, std::memory_order_release);
+        std::atomic_store(&metrics->current, std::shared_ptr<Metrics>());
+    }
+
+    // Routes that have seen at least one call or attempt
+    std::vector<EndpointMetrics> endpoint_metrics() const {
+        std::vector<EndpointMetrics> result;
+        auto current = current_metrics();
+        if (!current) return result;
+        for (int route = 0; route < Metrics::RouteCount; ++route) {
+            const EndpointStats& stats = current->routes[route];
+            EndpointMetrics m;
+            m.calls = stats.calls.load(std::memory_order_relaxed);
+            m.attempts = stats.attempts.load(std::memory_order_relaxed);
+            if (m.calls == 0 && m.attempts == 0) continue;
+            m.endpoint = Metrics::route_name(route);
+            m.response_bytes = stats.response_bytes.load(std::memory_order_relaxed);
+            m.cache_hits = stats.cache_hits.load(std::memory_order_relaxed);
+            m.cache_misses = stats.cache_misses.load(std::memory_order_relaxed);
+            m.cache_revalidations = stats.cache_revalidations.load(std::memory_order_relaxed);
+            m.coalesced = stats.coalesced.load(std::memory_order_relaxed);
+            for (int i = 0; i < 6; ++i) m.status_classes[i] = stats.status_classes[i].load(std::memory_order_relaxed);
+            m.queue = stats.queue.snapshot();
+            m.ttfb = stats.ttfb.snapshot();
+            m.body = stats.body.snapshot();
+            m.total = stats.total.snapshot();
+            result.push_back(m);
+        }
+        return result;
+    }
+
+    // Prometheus text exposition format of endpoint_metrics()
+    std::string metrics_prometheus() const {
+        auto all = endpoint_metrics();
+        std::ostringstream out;
+        out.precision(10);
+        auto counter = [&](const char* name, const char* help, uint64_t EndpointMetrics::* field) {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+            for (const auto& m : all) out << name << "{endpoint=\"" << m.endpoint << "\"} " << m.*field << "\n";
+        };
+        counter("opendatasoft_calls_total", "API calls completed.", &EndpointMetrics::calls);
+        counter("opendatasoft_attempts_total", "HTTP requests sent, including retries and hedges.", &EndpointMetrics::attempts);
+        counter("opendatasoft_response_bytes_total", "Response body bytes received.", &EndpointMetrics::response_bytes);
+        counter("opendatasoft_coalesced_total", "Calls served by an identical in-flight call.", &EndpointMetrics::coalesced);
+
+        out << "# HELP opendatasoft_cache_total Response cache outcomes.\n# TYPE opendatasoft_cache_total counter\n";
+        for (const auto& m : all) {
+            out << "opendatasoft_cache_total{endpoint=\"" << m.endpoint << "\",outcome=\"hit\"} " << m.cache_hits << "\n";
+            out << "opendatasoft_cache_total{endpoint=\"" << m.endpoint << "\",outcome=\"miss\"} " << m.cache_misses << "\n";
+            out << "opendatasoft_cache_total{endpoint=\"" << m.endpoint << "\",outcome=\"revalidated\"} " << m.cache_revalidations << "\n";
+        }
+
+        static const char* const classes[6] = {"error", "1xx", "2xx", "3xx", "4xx", "5xx"};
+        out << "# HELP opendatasoft_responses_total HTTP attempts by status class.\n# TYPE opendatasoft_responses_total counter\n";
+        for (const auto& m : all) {
+            for (int i = 0; i < 6; ++i) {
+                if (m.status_classes[i] == 0) continue;
+                out << "opendatasoft_responses_total{endpoint=\"" << m.endpoint << "\",status=\"" << classes[i] << "\"} "
+                    << m.status_classes[i] << "\n";
+            }
+        }
+
+        out << "# HELP opendatasoft_phase_seconds Call latency by phase.\n# TYPE opendatasoft_phase_seconds histogram\n";
+        for (const auto& m : all) {
+            const std::pair<const char*, const HistogramSnapshot*> phases[4] = {
+                std::make_pair("queue", &m.queue), std::make_pair("ttfb", &m.ttfb),
+                std::make_pair("body", &m.body), std::make_pair("total", &m.total)
+            };
+            for (const auto& phase : phases) {
+                std::string labels = "endpoint=\"" + m.endpoint + "\",phase=\"" + phase.first + "\"";
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < phase.second->buckets.size(); ++i) {
+                    cumulative += phase.second->buckets[i];
+                    out << "opendatasoft_phase_seconds_bucket{" << labels << ",le=\"" << (uint64_t(2) << i) / 1e6 << "\"} " << cumulative << "\n";
+                }
+                out << "opendatasoft_phase_seconds_bucket{" << labels << ",le=\"+Inf\"} " << phase.second->count << "\n";
+                out << "opendatasoft_phase_seconds_sum{" << labels << "} " << phase.second->sum_us / 1e6 << "\n";
+                out << "opendatasoft_phase_seconds_count{" << labels << "} " << phase.second->count << "\n";
+            }
+        }
+        return out.str();
     }
 
     // Catalog endpoints
@@ -106,22 +2131,22 @@ public:
         bool include_links = false,
         bool include_app_metas = false) {
         
-        std::map<std::string, std::string> params;
+        Query query;
         
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!order_by.empty()) params["order_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(order_by)));
-        if (limit != 10) params["limit"] = std::to_string(limit);
-        if (offset != 0) params["offset"] = std::to_string(offset);
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
-        if (!group_by.empty()) params["group_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(group_by)));
-        if (include_links) params["include_links"] = "true";
-        if (include_app_metas) params["include_app_metas"] = "true";
+        query.select(select);
+        query.where(where);
+        query.order_by(order_by);
+        if (limit != 10) query.limit(limit);
+        if (offset != 0) query.offset(offset);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.lang(lang);
+        query.timezone(timezone);
+        query.group_by(group_by);
+        if (include_links) query.flag("include_links", true);
+        if (include_app_metas) query.flag("include_app_metas", true);
         
-        return make_api_call("/catalog/datasets" + build_query_params(params), "GET");
+        return make_api_call(query.endpoint("/catalog/datasets"), "GET");
     }
 
     pplx::task<json::value> get_catalog_exports() {
@@ -140,21 +2165,7 @@ public:
         const std::string& exclude = "",
         const std::string& lang = "",
         const std::string& timezone = "") {
-        
-        std::map<std::string, std::string> params;
-        
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!order_by.empty()) params["order_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(order_by)));
-        if (!group_by.empty()) params["group_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(group_by)));
-        if (limit != -1) params["limit"] = std::to_string(limit);
-        if (offset != 0) params["offset"] = std::to_string(offset);
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
-        
-        return make_api_call("/catalog/exports/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(format))) + build_query_params(params), "GET");
+        return make_api_call(export_catalog_endpoint(format, select, where, order_by, group_by, limit, offset, refine, exclude, lang, timezone), "GET");
     }
 
     pplx::task<json::value> export_catalog_csv(
@@ -172,28 +2183,7 @@ public:
         const std::string& list_separator = ",",
         bool quote_all = false,
         bool with_bom = true) {
-        
-        std::map<std::string, std::string> params;
-        
-        // Standard parameters
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!order_by.empty()) params["order_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(order_by)));
-        if (!group_by.empty()) params["group_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(group_by)));
-        if (limit != -1) params["limit"] = std::to_string(limit);
-        if (offset != 0) params["offset"] = std::to_string(offset);
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
-        
-        // CSV-specific parameters
-        if (delimiter != ";") params["delimiter"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(delimiter)));
-        if (list_separator != ",") params["list_separator"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(list_separator)));
-        if (quote_all) params["quote_all"] = "true";
-        if (!with_bom) params["with_bom"] = "false";
-        
-        return make_api_call("/catalog/exports/csv" + build_query_params(params), "GET");
+        return make_api_call(export_catalog_csv_endpoint(select, where, order_by, group_by, limit, offset, refine, exclude, lang, timezone, delimiter, list_separator, quote_all, with_bom), "GET");
     }
 
     pplx::task<json::value> export_catalog_dcat(
@@ -201,12 +2191,12 @@ public:
         const std::string& include_exports = "",
         bool use_labels_in_exports = true) {
         
-        std::map<std::string, std::string> params;
+        Query query;
         
-        if (!include_exports.empty()) params["include_exports"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(include_exports)));
-        if (!use_labels_in_exports) params["use_labels_in_exports"] = "false";
+        query.param("include_exports", include_exports);
+        if (!use_labels_in_exports) query.flag("use_labels_in_exports", false);
         
-        return make_api_call("/catalog/exports/dcat" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dcat_ap_format))) + build_query_params(params), "GET");
+        return make_api_call(query.endpoint("/catalog/exports/dcat" + OpenDataSoftQuery::encode(dcat_ap_format)), "GET");
     }
 
     pplx::task<json::value> get_catalog_facets(
@@ -216,15 +2206,15 @@ public:
         const std::string& where = "",
         const std::string& timezone = "") {
         
-        std::map<std::string, std::string> params;
+        Query query;
         
-        if (!facet.empty()) params["facet"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(facet)));
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
+        query.param("facet", facet);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.where(where);
+        query.timezone(timezone);
         
-        return make_api_call("/catalog/facets" + build_query_params(params), "GET");
+        return make_api_call(query.endpoint("/catalog/facets"), "GET");
     }
 
     // Dataset endpoints
@@ -236,15 +2226,15 @@ public:
         bool include_links = false,
         bool include_app_metas = false) {
         
-        std::map<std::string, std::string> params;
+        Query query;
         
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
-        if (include_links) params["include_links"] = "true";
-        if (include_app_metas) params["include_app_metas"] = "true";
+        query.select(select);
+        query.lang(lang);
+        query.timezone(timezone);
+        if (include_links) query.flag("include_links", true);
+        if (include_app_metas) query.flag("include_app_metas", true);
         
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + build_query_params(params), "GET");
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id)), "GET");
     }
 
     pplx::task<json::value> query_dataset_records(
@@ -261,27 +2251,11 @@ public:
         const std::string& timezone = "",
         bool include_links = false,
         bool include_app_metas = false) {
-        
-        std::map<std::string, std::string> params;
-        
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!group_by.empty()) params["group_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(group_by)));
-        if (!order_by.empty()) params["order_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(order_by)));
-        if (limit != 10) params["limit"] = std::to_string(limit);
-        if (offset != 0) params["offset"] = std::to_string(offset);
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
-        if (include_links) params["include_links"] = "true";
-        if (include_app_metas) params["include_app_metas"] = "true";
-        
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + "/records" + build_query_params(params), "GET");
+        return make_api_call(query_dataset_records_endpoint(dataset_id, select, where, group_by, order_by, limit, offset, refine, exclude, lang, timezone, include_links, include_app_metas), "GET");
     }
 
     pplx::task<json::value> get_dataset_exports(const std::string& dataset_id) {
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + "/exports", "GET");
+        return make_api_call("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/exports", "GET");
     }
 
     pplx::task<json::value> export_dataset(
@@ -299,23 +2273,7 @@ public:
         bool use_labels = false,
         bool compressed = false,
         int epsg = 4326) {
-        
-        std::map<std::string, std::string> params;
-        
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!order_by.empty()) params["order_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(order_by)));
-        if (!group_by.empty()) params["group_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(group_by)));
-        if (limit != -1) params["limit"] = std::to_string(limit);
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
-        if (use_labels) params["use_labels"] = "true";
-        if (compressed) params["compressed"] = "true";
-        if (epsg != 4326) params["epsg"] = std::to_string(epsg);
-        
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + "/exports/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(format))) + build_query_params(params), "GET");
+        return make_api_call(export_dataset_endpoint(dataset_id, format, select, where, order_by, group_by, limit, refine, exclude, lang, timezone, use_labels, compressed, epsg), "GET");
     }
 
     pplx::task<json::value> export_dataset_csv(
@@ -333,27 +2291,7 @@ public:
         const std::string& list_separator = ",",
         bool quote_all = false,
         bool with_bom = true) {
-        
-        std::map<std::string, std::string> params;
-        
-        // Standard parameters
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!order_by.empty()) params["order_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(order_by)));
-        if (!group_by.empty()) params["group_by"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(group_by)));
-        if (limit != -1) params["limit"] = std::to_string(limit);
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
-        
-        // CSV-specific parameters
-        if (delimiter != ";") params["delimiter"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(delimiter)));
-        if (list_separator != ",") params["list_separator"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(list_separator)));
-        if (quote_all) params["quote_all"] = "true";
-        if (!with_bom) params["with_bom"] = "false";
-        
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + "/exports/csv" + build_query_params(params), "GET");
+        return make_api_call(export_dataset_csv_endpoint(dataset_id, select, where, order_by, group_by, limit, refine, exclude, lang, timezone, delimiter, list_separator, quote_all, with_bom), "GET");
     }
 
     pplx::task<json::value> get_dataset_facets(
@@ -365,20 +2303,20 @@ public:
         const std::string& lang = "",
         const std::string& timezone = "") {
         
-        std::map<std::string, std::string> params;
+        Query query;
         
-        if (!where.empty()) params["where"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(where)));
-        if (!refine.empty()) params["refine"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(refine)));
-        if (!exclude.empty()) params["exclude"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(exclude)));
-        if (!facet.empty()) params["facet"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(facet)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
+        query.where(where);
+        query.refine(refine);
+        query.exclude(exclude);
+        query.param("facet", facet);
+        query.lang(lang);
+        query.timezone(timezone);
         
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + "/facets" + build_query_params(params), "GET");
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/facets"), "GET");
     }
 
     pplx::task<json::value> get_dataset_attachments(const std::string& dataset_id) {
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + "/attachments", "GET");
+        return make_api_call("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/attachments", "GET");
     }
 
     pplx::task<json::value> get_dataset_record(
@@ -388,13 +2326,737 @@ public:
         const std::string& lang = "",
         const std::string& timezone = "") {
         
-        std::map<std::string, std::string> params;
+        Query query;
         
-        if (!select.empty()) params["select"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(select)));
-        if (!lang.empty()) params["lang"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(lang)));
-        if (!timezone.empty()) params["timezone"] = utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(timezone)));
+        query.select(select);
+        query.lang(lang);
+        query.timezone(timezone);
         
-        return make_api_call("/catalog/datasets/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(dataset_id))) + "/records/" + utility::conversions::to_utf8string(web::uri::encode_data_string(utility::conversions::to_string_t(record_id))) + build_query_params(params), "GET");
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/records/" + OpenDataSoftQuery::encode(record_id)), "GET");
+    }
+
+    // Overloads taking a prebuilt Query. The query string is encoded once
+    // when the Query is filled in, so reusing a Query across calls costs one
+    // allocation per request for the endpoint string. CallOptions adds a
+    // cancellation token and/or deadline to the call; the string-argument
+    // methods above take none, so use these to cancel or bound a call.
+    pplx::task<json::value> get_catalog_datasets(const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/datasets"), "GET", options);
+    }
+
+    pplx::task<json::value> export_catalog(const std::string& format, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/exports/" + OpenDataSoftQuery::encode(format)), "GET", options);
+    }
+
+    pplx::task<json::value> export_catalog_csv(const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/exports/csv"), "GET", options);
+    }
+
+    pplx::task<json::value> export_catalog_dcat(const std::string& dcat_ap_format, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/exports/dcat" + OpenDataSoftQuery::encode(dcat_ap_format)), "GET", options);
+    }
+
+    pplx::task<json::value> get_catalog_facets(const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/facets"), "GET", options);
+    }
+
+    pplx::task<json::value> get_dataset_info(const std::string& dataset_id, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id)), "GET", options);
+    }
+
+    pplx::task<json::value> query_dataset_records(const std::string& dataset_id, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/records"), "GET", options);
+    }
+
+    pplx::task<json::value> export_dataset(const std::string& dataset_id, const std::string& format, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/exports/" + OpenDataSoftQuery::encode(format)), "GET", options);
+    }
+
+    pplx::task<json::value> export_dataset_csv(const std::string& dataset_id, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/exports/csv"), "GET", options);
+    }
+
+    pplx::task<json::value> get_dataset_facets(const std::string& dataset_id, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/facets"), "GET", options);
+    }
+
+    pplx::task<json::value> get_dataset_record(const std::string& dataset_id, const std::string& record_id, const Query& query, const CallOptions& options = CallOptions()) {
+        return make_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/records/" + OpenDataSoftQuery::encode(record_id)), "GET", options);
+    }
+
+    // decompress only applies when the query sets compressed=true
+    pplx::task<json::value> stream_export_dataset(
+        const std::string& dataset_id,
+        const std::string& format,
+        const ExportSink& sink,
+        const Query& query,
+        bool decompress = false,
+        const CallOptions& options = CallOptions()) {
+        return stream_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/exports/" + OpenDataSoftQuery::encode(format)), sink, decompress, options);
+    }
+
+    pplx::task<json::value> stream_export_dataset_csv(
+        const std::string& dataset_id,
+        const ExportSink& sink,
+        const Query& query,
+        const CallOptions& options = CallOptions()) {
+        return stream_api_call(query.endpoint("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) + "/exports/csv"), sink, false, options);
+    }
+
+    pplx::task<json::value> stream_export_catalog(
+        const std::string& format,
+        const ExportSink& sink,
+        const Query& query,
+        const CallOptions& options = CallOptions()) {
+        return stream_api_call(query.endpoint("/catalog/exports/" + OpenDataSoftQuery::encode(format)), sink, false, options);
+    }
+
+    pplx::task<json::value> stream_export_catalog_csv(
+        const ExportSink& sink,
+        const Query& query,
+        const CallOptions& options = CallOptions()) {
+        return stream_api_call(query.endpoint("/catalog/exports/csv"), sink, false, options);
+    }
+
+    // Streaming exports. The body is handed to the sink chunk by chunk instead
+    // of being parsed, so any export format works and memory stays bounded.
+    // The result reports bytes received/written, or an error object.
+    pplx::task<json::value> stream_export_catalog(
+        const std::string& format,
+        const ExportSink& sink,
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        const std::string& group_by = "",
+        int limit = -1,
+        int offset = 0,
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "") {
+        return stream_api_call(export_catalog_endpoint(format, select, where, order_by, group_by, limit, offset, refine, exclude, lang, timezone), sink, false);
+    }
+
+    pplx::task<json::value> stream_export_catalog_csv(
+        const ExportSink& sink,
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        const std::string& group_by = "",
+        int limit = -1,
+        int offset = 0,
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "",
+        const std::string& delimiter = ";",
+        const std::string& list_separator = ",",
+        bool quote_all = false,
+        bool with_bom = true) {
+        return stream_api_call(export_catalog_csv_endpoint(select, where, order_by, group_by, limit, offset, refine, exclude, lang, timezone, delimiter, list_separator, quote_all, with_bom), sink, false);
+    }
+
+    pplx::task<json::value> stream_export_dataset(
+        const std::string& dataset_id,
+        const std::string& format,
+        const ExportSink& sink,
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        const std::string& group_by = "",
+        int limit = -1,
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "",
+        bool use_labels = false,
+        bool compressed = false,
+        int epsg = 4326,
+        bool decompress = false) {
+        return stream_api_call(export_dataset_endpoint(dataset_id, format, select, where, order_by, group_by, limit, refine, exclude, lang, timezone, use_labels, compressed, epsg), sink, compressed && decompress);
+    }
+
+    pplx::task<json::value> stream_export_dataset_csv(
+        const std::string& dataset_id,
+        const ExportSink& sink,
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        const std::string& group_by = "",
+        int limit = -1,
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "",
+        const std::string& delimiter = ";",
+        const std::string& list_separator = ",",
+        bool quote_all = false,
+        bool with_bom = true) {
+        return stream_api_call(export_dataset_csv_endpoint(dataset_id, select, where, order_by, group_by, limit, refine, exclude, lang, timezone, delimiter, list_separator, quote_all, with_bom), sink, false);
+    }
+
+    // Record paging. A cursor walks query_dataset_records page by page and
+    // keeps up to prefetch_pages requests in flight ahead of the consumer.
+    // The API caps offset paging at offset + limit <= 10000; past that the
+    // cursor switches to keyset paging (keyset_field > last value), so
+    // keyset_field must be sortable and unique. When set it is also the sort
+    // order and is added to select if missing; a page whose last record
+    // lacks it ends the cursor with an error. A cursor serves one consumer, which must wait for each batch
+    // before asking for the next; the API object must outlive it. options
+    // applies to every page request, so its timeout bounds each page.
+    class RecordCursor {
+    public:
+        // Resolves to the next page of records; empty once exhausted.
+        pplx::task<std::vector<json::value>> next_batch() {
+            auto state = this->state;
+            pplx::task<json::value> page;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->buffered.empty()) {
+                    std::vector<json::value> records(state->buffered.begin(), state->buffered.end());
+                    state->buffered.clear();
+                    return pplx::task_from_result(records);
+                }
+                state->fill();
+                if (state->pending.empty()) {
+                    state->exhausted = true;
+                    return pplx::task_from_result(std::vector<json::value>());
+                }
+                page = state->pending.front();
+                state->pending.pop_front();
+            }
+            return page.then([state](json::value result) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                auto records = state->process(result);
+                state->fill();
+                return records;
+            });
+        }
+
+        // Resolves to the next record, or to null once exhausted.
+        pplx::task<json::value> next() {
+            auto state = this->state;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->buffered.empty()) {
+                    json::value record = state->buffered.front();
+                    state->buffered.pop_front();
+                    return pplx::task_from_result(record);
+                }
+            }
+            return next_batch().then([state](std::vector<json::value> records) {
+                if (records.empty()) return json::value::null();
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->buffered.insert(state->buffered.end(), records.begin() + 1, records.end());
+                return records.front();
+            });
+        }
+
+        bool done() const {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return state->exhausted && state->buffered.empty();
+        }
+
+        // The error object that ended the cursor early, or null.
+        json::value error() const {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return state->error;
+        }
+
+    private:
+        friend class OpenDataSoftAPI;
+
+        struct State {
+            OpenDataSoftAPI* api;
+            std::string dataset_id, select, where, order_by, refine, exclude, lang, timezone, keyset_field;
+            int page_size;
+            size_t prefetch_pages;
+            CallOptions options;
+
+            mutable std::mutex mutex;
+            int next_offset = 0;
+            long long total_count = -1;
+            bool keyset = false;
+            bool exhausted = false;
+            bool have_last_key = false;
+            std::string last_key;
+            std::deque<pplx::task<json::value>> pending;
+            std::deque<json::value> buffered;
+            json::value error;
+
+            void fill() {
+                while (!exhausted && pending.size() < prefetch_pages) {
+                    if (!keyset) {
+                        if (total_count >= 0 && next_offset >= total_count) return;
+                        if (next_offset + page_size <= max_offset_window) {
+                            pending.push_back(fetch_page(where, next_offset));
+                            next_offset += page_size;
+                            continue;
+                        }
+                        if (keyset_field.empty()) {
+                            if (pending.empty()) {
+                                exhausted = true;
+                                error = make_error(U("Offset limit reached; set keyset_field to page further"));
+                            }
+                            return;
+                        }
+                        // The first keyset page needs the last key of the final offset page
+                        if (!pending.empty()) return;
+                        keyset = true;
+                    }
+                    // Each keyset page depends on the last key of its predecessor
+                    if (!pending.empty() || !have_last_key) return;
+                    std::string keyset_where = (where.empty() ? "" : "(" + where + ") AND ") + keyset_field + " > " + last_key;
+                    pending.push_back(fetch_page(keyset_where, 0));
+                }
+            }
+
+            pplx::task<json::value> fetch_page(const std::string& page_where, int offset) {
+                return api->make_api_call(api->query_dataset_records_endpoint(dataset_id, select, page_where, "", sort_order(),
+                    page_size, offset, refine, exclude, lang, timezone, false, false), "GET", options);
+            }
+
+            std::vector<json::value> process(const json::value& page) {
+                std::vector<json::value> records;
+                if (page.has_field(U("error"))) {
+                    error = page;
+                    exhausted = true;
+                    pending.clear();
+                    return records;
+                }
+                if (page.has_field(U("total_count"))) {
+                    total_count = page.at(U("total_count")).as_number().to_int64();
+                }
+                if (page.has_field(U("results"))) {
+                    const auto& results = page.at(U("results")).as_array();
+                    records.assign(results.begin(), results.end());
+                }
+                if (records.size() < static_cast<size_t>(page_size)) {
+                    exhausted = true;
+                    pending.clear();
+                }
+                if (!records.empty() && !keyset_field.empty()) {
+                    auto key = utility::conversions::to_string_t(keyset_field);
+                    if (records.back().has_field(key)) {
+                        last_key = odsql_literal(records.back().at(key));
+                        have_last_key = true;
+                    } else if (!exhausted) {
+                        // Without the key the cursor could not page past the offset limit
+                        error = make_error(utility::conversions::to_string_t("Records lack keyset_field " + keyset_field));
+                        exhausted = true;
+                        pending.clear();
+                    }
+                }
+                return records;
+            }
+
+            std::string sort_order() const {
+                return keyset_field.empty() ? order_by : keyset_field;
+            }
+        };
+
+        std::shared_ptr<State> state;
+    };
+
+    RecordCursor records_cursor(
+        const std::string& dataset_id,
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "",
+        int page_size = 100,
+        size_t prefetch_pages = 4,
+        const std::string& keyset_field = "",
+        const CallOptions& options = CallOptions()) {
+
+        RecordCursor cursor;
+        cursor.state = std::make_shared<RecordCursor::State>();
+        auto& state = *cursor.state;
+        state.api = this;
+        state.dataset_id = dataset_id;
+        state.select = select;
+        state.where = where;
+        state.order_by = order_by;
+        state.refine = refine;
+        state.exclude = exclude;
+        state.lang = lang;
+        state.timezone = timezone;
+        state.keyset_field = keyset_field;
+        state.options = options;
+        // Keyset paging reads keyset_field from every page
+        if (!keyset_field.empty() && !select.empty() && !selects_field(select, keyset_field)) {
+            state.select = select + ", " + keyset_field;
+        }
+        // The records endpoint returns at most 100 records per call
+        state.page_size = page_size < 1 ? 1 : (page_size > 100 ? 100 : page_size);
+        state.prefetch_pages = prefetch_pages == 0 ? 1 : prefetch_pages;
+        return cursor;
+    }
+
+    // Bulk download. The dataset is split into disjoint partitions that are
+    // fetched concurrently (bounded by max_in_flight), retried individually
+    // up to max_retries times after the retry policy's backoff, and handed
+    // to the sink in partition order from one thread at a time.
+    //
+    // With partition_field and partition_bounds (ascending ODSQL literals,
+    // e.g. "100" or "date'2021-01-01'"), each range between consecutive
+    // bounds, plus the open ranges below the first and from the last bound,
+    // becomes one /exports/json request, which has no offset limit.
+    // Otherwise the dataset is split into 100-record offset windows over
+    // /records; this only works up to the API's 10000 record offset limit,
+    // and requires order_by, which should name a unique field so windows
+    // neither overlap nor skip records.
+    //
+    // The result summarizes partitions and records; partitions that still
+    // fail after retrying are listed under failed_partitions. options
+    // applies to each request; cancelling its token fails the remaining
+    // partitions. The API object must outlive the returned task.
+    pplx::task<json::value> bulk_fetch_dataset(
+        const std::string& dataset_id,
+        const RecordSink& sink,
+        const std::string& partition_field = "",
+        const std::vector<std::string>& partition_bounds = std::vector<std::string>(),
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "",
+        size_t max_in_flight = 8,
+        int max_retries = 3,
+        const ProgressCallback& progress = ProgressCallback(),
+        const CallOptions& options = CallOptions()) {
+
+        auto bulk = std::make_shared<BulkFetch>();
+        bulk->sink = sink;
+        bulk->progress = progress;
+        bulk->max_in_flight = max_in_flight == 0 ? 1 : max_in_flight;
+        bulk->max_retries = max_retries < 0 ? 0 : max_retries;
+        bulk->control = control;
+        bulk->policy = control->retry_policy_for("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id) +
+                                                 (partition_field.empty() ? "/records" : "/exports/json"));
+        bulk->token = options.token;
+
+        if (!partition_field.empty()) {
+            std::vector<std::string> predicates;
+            if (partition_bounds.empty()) {
+                predicates.push_back("");
+            } else {
+                predicates.push_back(partition_field + " < " + partition_bounds.front());
+                for (size_t i = 1; i < partition_bounds.size(); ++i) {
+                    predicates.push_back(partition_field + " >= " + partition_bounds[i - 1] + " AND " +
+                                         partition_field + " < " + partition_bounds[i]);
+                }
+                predicates.push_back(partition_field + " >= " + partition_bounds.back());
+            }
+            std::string sort = order_by.empty() ? partition_field : order_by;
+            for (const auto& predicate : predicates) {
+                std::string partition_where = predicate.empty() ? where : and_where(where, predicate);
+                auto endpoint = export_dataset_endpoint(dataset_id, "json", select, partition_where, sort, "", -1,
+                                                        refine, exclude, lang, timezone, false, false, 4326);
+                bulk->partitions.push_back([this, endpoint, options]() { return make_api_call(endpoint, "GET", options); });
+            }
+            return run_bulk_fetch(bulk);
+        }
+
+        // Without a defined order, offset windows can overlap or skip records
+        if (order_by.empty()) {
+            return pplx::task_from_result(make_error(
+                U("Offset partitioning requires order_by; set it to a unique field or use partition_field")));
+        }
+
+        const int window = 100;
+        auto count_endpoint = query_dataset_records_endpoint(dataset_id, "", where, "", "", 0, 0, refine, exclude, "", "", false, false);
+        return make_api_call(count_endpoint, "GET", options)
+            .then([this, bulk, window, dataset_id, select, where, order_by, refine, exclude, lang, timezone, options](json::value result) {
+                if (result.has_field(U("error"))) return pplx::task_from_result(result);
+                int64_t total = result.has_field(U("total_count")) ? result.at(U("total_count")).as_number().to_int64() : 0;
+                if (total > max_offset_window) {
+                    return pplx::task_from_result(make_error(
+                        U("Dataset exceeds the offset limit; set partition_field and partition_bounds")));
+                }
+                for (int offset = 0; offset < total; offset += window) {
+                    auto endpoint = query_dataset_records_endpoint(dataset_id, select, where, "", order_by, window, offset,
+                                                                   refine, exclude, lang, timezone, false, false);
+                    bulk->partitions.push_back([this, endpoint, options]() { return make_api_call(endpoint, "GET", options); });
+                }
+                return run_bulk_fetch(bulk);
+            });
+    }
+
+    // Columnar decoding. Records are parsed straight from the response bytes
+    // into per-field arrays typed by the dataset schema (see
+    // OpenDataSoftRecordBatch.h), skipping the json::value tree. A failed call
+    // yields an empty batch whose error holds the usual error object.
+    pplx::task<RecordSchema> get_dataset_schema(const std::string& dataset_id) {
+        return get_dataset_info(dataset_id).then([](json::value info) {
+            return RecordSchema::from_dataset_info(info);
+        });
+    }
+
+    pplx::task<std::shared_ptr<RecordBatch>> query_dataset_records_columnar(
+        const std::string& dataset_id,
+        const RecordSchema& schema,
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        int limit = 10,
+        int offset = 0,
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "") {
+        return decode_api_call(query_dataset_records_endpoint(dataset_id, select, where, "", order_by, limit, offset, refine, exclude, lang, timezone, false, false), schema);
+    }
+
+    pplx::task<std::shared_ptr<RecordBatch>> export_dataset_columnar(
+        const std::string& dataset_id,
+        const RecordSchema& schema,
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& order_by = "",
+        int limit = -1,
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "") {
+        return decode_api_call(export_dataset_endpoint(dataset_id, "json", select, where, order_by, "", limit, refine, exclude, lang, timezone, false, false, 4326), schema);
+    }
+
+    // Incremental sync. Keeps a local copy of a dataset in snapshot_dir as
+    // <dataset_id>.jsonl (one record per line, keyed by key_field) next to
+    // <dataset_id>.state.json, which holds the dataset's modified and
+    // data_processed metadata and the highest timestamp_field value seen.
+    // When the metadata is unchanged the run stops after get_dataset_info.
+    // Otherwise only records with timestamp_field at or above the watermark
+    // are exported and upserted; records sharing the watermark's timestamp
+    // are fetched again so later writes with that timestamp are not missed.
+    // Deleted records are not detected; delete the state file to force a
+    // full refresh. Dataset ids containing '/', '\' or ".." are rejected.
+    // options applies to the metadata and export requests separately.
+    pplx::task<json::value> sync_dataset(
+        const std::string& dataset_id,
+        const std::string& snapshot_dir,
+        const std::string& timestamp_field,
+        const std::string& key_field,
+        const std::string& where = "",
+        const CallOptions& options = CallOptions()) {
+
+        if (!is_safe_file_name(dataset_id)) {
+            return pplx::task_from_result(make_error(
+                utility::conversions::to_string_t("Dataset id cannot name a snapshot file: " + dataset_id)));
+        }
+        std::string snapshot_path = snapshot_dir + "/" + dataset_id + ".jsonl";
+        std::string state_path = snapshot_dir + "/" + dataset_id + ".state.json";
+
+        json::value state = json::value::object();
+        {
+            std::ifstream in(state_path, std::ios::binary);
+            if (in) {
+                std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                try {
+                    state = json::value::parse(utility::conversions::to_string_t(text));
+                } catch (const std::exception&) {
+                    state = json::value::object();
+                }
+            }
+        }
+        std::string previous_stamp = state.has_field(U("stamp")) ? utility::conversions::to_utf8string(state.at(U("stamp")).as_string()) : "";
+        json::value watermark = state.has_field(U("watermark")) ? state.at(U("watermark")) : json::value::null();
+
+        // The metadata and the delta must be current, so neither comes from the cache
+        return make_api_call("/catalog/datasets/" + OpenDataSoftQuery::encode(dataset_id), "GET", options, false)
+            .then([this, dataset_id, snapshot_dir, snapshot_path, state_path, timestamp_field,
+                   key_field, where, previous_stamp, watermark, options](json::value info) {
+                if (info.has_field(U("error"))) return pplx::task_from_result(info);
+
+                std::string stamp = dataset_stamp(info);
+                if (!previous_stamp.empty() && stamp == previous_stamp) {
+                    json::value result;
+                    result[U("success")] = json::value::boolean(true);
+                    result[U("changed")] = json::value::boolean(false);
+                    result[U("fetched")] = json::value::number(0);
+                    result[U("watermark")] = watermark;
+                    return pplx::task_from_result(result);
+                }
+
+                std::string delta_where = where;
+                if (!watermark.is_null()) delta_where = and_where(where, timestamp_field + " >= " + odsql_literal(watermark));
+
+                auto delta_endpoint = export_dataset_endpoint(dataset_id, "json", "", delta_where, timestamp_field, "", -1,
+                                                              "", "", "", "", false, false, 4326);
+                return make_api_call(delta_endpoint, "GET", options, false)
+                    .then([=](json::value delta) {
+                        if (delta.is_object() && delta.has_field(U("error"))) return delta;
+                        if (!delta.is_array()) return make_error(U("Unexpected export response"));
+
+                        // Existing snapshot lines, keyed by the serialized key_field value
+                        std::map<std::string, std::string> records;
+                        {
+                            std::ifstream in(snapshot_path, std::ios::binary);
+                            std::string line;
+                            while (std::getline(in, line)) {
+                                if (line.empty()) continue;
+                                try {
+                                    auto record = json::value::parse(utility::conversions::to_string_t(line));
+                                    auto key = utility::conversions::to_string_t(key_field);
+                                    if (record.has_field(key)) records[utility::conversions::to_utf8string(record.at(key).serialize())] = line;
+                                } catch (const std::exception&) {
+                                }
+                            }
+                        }
+
+                        json::value new_watermark = watermark;
+                        auto key = utility::conversions::to_string_t(key_field);
+                        auto timestamp = utility::conversions::to_string_t(timestamp_field);
+                        for (const auto& record : delta.as_array()) {
+                            if (!record.has_field(key)) continue;
+                            records[utility::conversions::to_utf8string(record.at(key).serialize())] =
+                                utility::conversions::to_utf8string(record.serialize());
+                            if (record.has_field(timestamp) && !record.at(timestamp).is_null() &&
+                                (new_watermark.is_null() || json_less(new_watermark, record.at(timestamp)))) {
+                                new_watermark = record.at(timestamp);
+                            }
+                        }
+
+                        std::string snapshot;
+                        for (const auto& record : records) {
+                            snapshot += record.second;
+                            snapshot += "\n";
+                        }
+                        json::value new_state;
+                        new_state[U("stamp")] = json::value::string(utility::conversions::to_string_t(stamp));
+                        new_state[U("watermark")] = new_watermark;
+                        new_state[U("records")] = json::value::number(static_cast<uint64_t>(records.size()));
+
+                        // Snapshot first: a crash in between re-applies the delta next run
+                        if (!write_file_atomically(snapshot_path, snapshot) ||
+                            !write_file_atomically(state_path, utility::conversions::to_utf8string(new_state.serialize()))) {
+                            return make_error(utility::conversions::to_string_t("Failed to write snapshot in " + snapshot_dir));
+                        }
+
+                        json::value result;
+                        result[U("success")] = json::value::boolean(true);
+                        result[U("changed")] = json::value::boolean(true);
+                        result[U("fetched")] = json::value::number(static_cast<uint64_t>(delta.size()));
+                        result[U("records")] = json::value::number(static_cast<uint64_t>(records.size()));
+                        result[U("watermark")] = new_watermark;
+                        return result;
+                    });
+            });
+    }
+
+    // Batch lookups. Calls run with at most max_in_flight outstanding; the
+    // result holds one entry per input in input order, each either the
+    // endpoint's response or its error object, plus the number that failed.
+    pplx::task<json::value> get_dataset_infos(
+        const std::vector<std::string>& dataset_ids,
+        const std::string& select = "",
+        const std::string& lang = "",
+        const std::string& timezone = "",
+        size_t max_in_flight = 8) {
+
+        auto batch = std::make_shared<BatchCall>();
+        batch->max_in_flight = max_in_flight;
+        for (const auto& dataset_id : dataset_ids) {
+            batch->calls.push_back([this, dataset_id, select, lang, timezone]() {
+                return get_dataset_info(dataset_id, select, lang, timezone);
+            });
+        }
+        return run_batch(batch);
+    }
+
+    // With id_field set, lookups are collapsed into /records queries of up to
+    // 100 ids each, matching id_field against the given ids. Integer ids are
+    // sent as numbers and others as strings, so id_field may be an int or a
+    // text field; a text field holding digit-only ids should be looked up
+    // without id_field. Otherwise each id is fetched from /records/{record_id}.
+    pplx::task<json::value> get_dataset_records(
+        const std::string& dataset_id,
+        const std::vector<std::string>& record_ids,
+        const std::string& select = "",
+        const std::string& lang = "",
+        const std::string& timezone = "",
+        const std::string& id_field = "",
+        size_t max_in_flight = 8) {
+
+        auto batch = std::make_shared<BatchCall>();
+        batch->max_in_flight = max_in_flight;
+        if (id_field.empty()) {
+            for (const auto& record_id : record_ids) {
+                batch->calls.push_back([this, dataset_id, record_id, select, lang, timezone]() {
+                    return get_dataset_record(dataset_id, record_id, select, lang, timezone);
+                });
+            }
+            return run_batch(batch);
+        }
+
+        // Chunks are also capped by predicate length to keep URLs short
+        const size_t max_ids = 100;
+        const size_t max_predicate = 4000;
+        std::string fields = select.empty() ? "" : select + ", " + id_field;
+        auto chunk_of = std::make_shared<std::vector<size_t>>();
+        std::vector<std::string> seen;
+        std::string predicate;
+        size_t ids_in_chunk = 0;
+        auto flush = [&]() {
+            if (ids_in_chunk == 0) return;
+            auto endpoint = query_dataset_records_endpoint(dataset_id, fields, predicate, "", "", static_cast<int>(ids_in_chunk), 0, "", "", lang, timezone, false, false);
+            batch->calls.push_back([this, endpoint]() { return make_api_call(endpoint, "GET"); });
+            predicate.clear();
+            seen.clear();
+            ids_in_chunk = 0;
+        };
+        for (const auto& record_id : record_ids) {
+            if (std::find(seen.begin(), seen.end(), record_id) == seen.end()) {
+                std::string term = id_field + " = " + id_literal(record_id);
+                if (ids_in_chunk == max_ids || (ids_in_chunk > 0 && predicate.size() + term.size() > max_predicate)) flush();
+                predicate += predicate.empty() ? term : " OR " + term;
+                seen.push_back(record_id);
+                ++ids_in_chunk;
+            }
+            chunk_of->push_back(batch->calls.size());
+        }
+        flush();
+
+        return run_batch(batch).then([batch, record_ids, id_field, chunk_of](json::value) {
+            const auto& chunks = batch->results;
+            std::vector<std::map<std::string, json::value>> found(chunks.size());
+            auto key = utility::conversions::to_string_t(id_field);
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                if (!chunks[i].has_field(U("results"))) continue;
+                for (const auto& record : chunks[i].at(U("results")).as_array()) {
+                    if (record.has_field(key)) found[i][record_key(record.at(key))] = record;
+                }
+            }
+
+            json::value results = json::value::array(record_ids.size());
+            uint64_t failed = 0;
+            for (size_t i = 0; i < record_ids.size(); ++i) {
+                size_t chunk = (*chunk_of)[i];
+                auto match = found[chunk].find(record_ids[i]);
+                if (match != found[chunk].end()) {
+                    results[i] = match->second;
+                    continue;
+                }
+                ++failed;
+                const auto& response = chunks[chunk];
+                results[i] = response.has_field(U("error"))
+                    ? response
+                    : make_error(utility::conversions::to_string_t("Record not found: " + record_ids[i]));
+            }
+
+            json::value result;
+            result[U("success")] = json::value::boolean(true);
+            result[U("count")] = json::value::number(static_cast<uint64_t>(record_ids.size()));
+            result[U("failed")] = json::value::number(failed);
+            result[U("results")] = results;
+            return result;
+        });
     }
 };
 
@@ -0,0 +1,318 @@
+#ifndef OPENDATASOFT_ARROW_H
+#define OPENDATASOFT_ARROW_H
+
+// Optional Arrow/Parquet output for dataset exports. Requires Apache Arrow
+// with Parquet support; link with -larrow -lparquet in addition to the
+// cpprest libraries.
+
+#include "OpenDataSoftAPI.h"
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/properties.h>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+enum class ColumnarFileFormat {
+    Parquet,
+    ArrowIpc
+};
+
+inline std::shared_ptr<arrow::DataType> arrow_type(FieldType type) {
+    switch (type) {
+    case FieldType::Integer: return arrow::int64();
+    case FieldType::Double: return arrow::float64();
+    case FieldType::Boolean: return arrow::boolean();
+    case FieldType::Date: return arrow::date32();
+    case FieldType::DateTime: return arrow::timestamp(arrow::TimeUnit::MILLI, "UTC");
+    case FieldType::GeoPoint:
+        return arrow::struct_({arrow::field("lat", arrow::float64()), arrow::field("lon", arrow::float64())});
+    case FieldType::Text:
+    default:
+        return arrow::utf8();
+    }
+}
+
+inline std::shared_ptr<arrow::Schema> arrow_schema(const RecordSchema& schema) {
+    arrow::FieldVector fields;
+    for (const auto& field : schema.fields) {
+        fields.push_back(arrow::field(field.name, arrow_type(field.type)));
+    }
+    return arrow::schema(fields);
+}
+
+inline arrow::Result<std::shared_ptr<arrow::Array>> to_arrow_array(const Column& column) {
+    const size_t rows = column.size();
+    std::shared_ptr<arrow::Array> array;
+    switch (column.field.type) {
+    case FieldType::Integer: {
+        arrow::Int64Builder builder;
+        ARROW_RETURN_NOT_OK(builder.AppendValues(column.ints.data(), rows, column.valid.data()));
+        ARROW_RETURN_NOT_OK(builder.Finish(&array));
+        break;
+    }
+    case FieldType::Double: {
+        arrow::DoubleBuilder builder;
+        ARROW_RETURN_NOT_OK(builder.AppendValues(column.doubles.data(), rows, column.valid.data()));
+        ARROW_RETURN_NOT_OK(builder.Finish(&array));
+        break;
+    }
+    case FieldType::Boolean: {
+        arrow::BooleanBuilder builder;
+        ARROW_RETURN_NOT_OK(builder.Reserve(rows));
+        for (size_t i = 0; i < rows; ++i) {
+            if (column.valid[i]) builder.UnsafeAppend(column.ints[i] != 0);
+            else builder.UnsafeAppendNull();
+        }
+        ARROW_RETURN_NOT_OK(builder.Finish(&array));
+        break;
+    }
+    case FieldType::Date: {
+        arrow::Date32Builder builder;
+        ARROW_RETURN_NOT_OK(builder.Reserve(rows));
+        for (size_t i = 0; i < rows; ++i) {
+            if (column.valid[i]) builder.UnsafeAppend(static_cast<int32_t>(column.ints[i]));
+            else builder.UnsafeAppendNull();
+        }
+        ARROW_RETURN_NOT_OK(builder.Finish(&array));
+        break;
+    }
+    case FieldType::DateTime: {
+        arrow::TimestampBuilder builder(arrow_type(FieldType::DateTime), arrow::default_memory_pool());
+        ARROW_RETURN_NOT_OK(builder.AppendValues(column.ints.data(), rows, column.valid.data()));
+        ARROW_RETURN_NOT_OK(builder.Finish(&array));
+        break;
+    }
+    case FieldType::GeoPoint: {
+        auto lat = std::make_shared<arrow::DoubleBuilder>();
+        auto lon = std::make_shared<arrow::DoubleBuilder>();
+        arrow::StructBuilder builder(arrow_type(FieldType::GeoPoint), arrow::default_memory_pool(), {lat, lon});
+        ARROW_RETURN_NOT_OK(builder.Reserve(rows));
+        ARROW_RETURN_NOT_OK(lat->Reserve(rows));
+        ARROW_RETURN_NOT_OK(lon->Reserve(rows));
+        for (size_t i = 0; i < rows; ++i) {
+            if (column.valid[i]) {
+                ARROW_RETURN_NOT_OK(builder.Append());
+                lat->UnsafeAppend(column.doubles[2 * i]);
+                lon->UnsafeAppend(column.doubles[2 * i + 1]);
+            } else {
+                ARROW_RETURN_NOT_OK(builder.AppendNull());
+            }
+        }
+        ARROW_RETURN_NOT_OK(builder.Finish(&array));
+        break;
+    }
+    case FieldType::Text:
+    default: {
+        arrow::StringBuilder builder;
+        ARROW_RETURN_NOT_OK(builder.Reserve(rows));
+        ARROW_RETURN_NOT_OK(builder.ReserveData(column.data.size()));
+        for (size_t i = 0; i < rows; ++i) {
+            if (column.valid[i]) {
+                builder.UnsafeAppend(column.data.data() + column.offsets[i],
+                                     static_cast<int32_t>(column.offsets[i + 1] - column.offsets[i]));
+            } else {
+                builder.UnsafeAppendNull();
+            }
+        }
+        ARROW_RETURN_NOT_OK(builder.Finish(&array));
+        break;
+    }
+    }
+    return array;
+}
+
+inline arrow::Result<std::shared_ptr<arrow::RecordBatch>> to_arrow(const RecordBatch& batch,
+                                                                   const std::shared_ptr<arrow::Schema>& schema) {
+    arrow::ArrayVector arrays;
+    for (const auto& column : batch.columns) {
+        ARROW_ASSIGN_OR_RAISE(auto array, to_arrow_array(column));
+        arrays.push_back(array);
+    }
+    return arrow::RecordBatch::Make(schema, static_cast<int64_t>(batch.num_rows), arrays);
+}
+
+// ExportSink target for a streamed /exports/jsonl body. Complete lines are
+// decoded into a RecordBatch that is written out as one Parquet row group
+// (or one IPC record batch) every row_group_rows rows, so memory stays at
+// one row group regardless of dataset size.
+class ColumnarFileWriter {
+public:
+    static arrow::Result<std::shared_ptr<ColumnarFileWriter>> Open(
+        const std::string& path, const RecordSchema& schema, ColumnarFileFormat format, size_t row_group_rows) {
+        std::shared_ptr<ColumnarFileWriter> writer(new ColumnarFileWriter(schema, row_group_rows));
+        ARROW_ASSIGN_OR_RAISE(writer->file, arrow::io::FileOutputStream::Open(path));
+        if (format == ColumnarFileFormat::Parquet) {
+            auto properties = parquet::WriterProperties::Builder()
+                .max_row_group_length(static_cast<int64_t>(writer->row_group_rows))
+                ->build();
+            ARROW_ASSIGN_OR_RAISE(writer->parquet_writer, parquet::arrow::FileWriter::Open(
+                *writer->schema, arrow::default_memory_pool(), writer->file, properties));
+        } else {
+            ARROW_ASSIGN_OR_RAISE(writer->ipc_writer, arrow::ipc::MakeFileWriter(writer->file, writer->schema));
+        }
+        return writer;
+    }
+
+    // Feeds a chunk of the jsonl body; throws on decode or write errors
+    void write(const char* data, size_t size) {
+        const char* end = data + size;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(std::memchr(data, '\n', end - data));
+            if (!newline) {
+                pending.append(data, end - data);
+                return;
+            }
+            if (pending.empty()) {
+                decode_line(data, newline - data);
+            } else {
+                pending.append(data, newline - data);
+                decode_line(pending.data(), pending.size());
+                pending.clear();
+            }
+            data = newline + 1;
+        }
+    }
+
+    arrow::Status close() {
+        if (!pending.empty()) {
+            decode_line(pending.data(), pending.size());
+            pending.clear();
+        }
+        ARROW_RETURN_NOT_OK(flush());
+        if (parquet_writer) ARROW_RETURN_NOT_OK(parquet_writer->Close());
+        if (ipc_writer) ARROW_RETURN_NOT_OK(ipc_writer->Close());
+        return file->Close();
+    }
+
+    // Gives up on a failed export: closes the file without writing the
+    // footer or any buffered rows
+    void abort() {
+        if (file && !file->closed()) (void)file->Close();
+    }
+
+    uint64_t rows_written() const { return rows; }
+
+private:
+    RecordSchema record_schema;
+    std::shared_ptr<arrow::Schema> schema;
+    size_t row_group_rows;
+    RecordBatch batch;
+    RecordBatchDecoder decoder;
+    std::string pending;
+    uint64_t rows = 0;
+
+    std::shared_ptr<arrow::io::FileOutputStream> file;
+    std::unique_ptr<parquet::arrow::FileWriter> parquet_writer;
+    std::shared_ptr<arrow::ipc::RecordBatchWriter> ipc_writer;
+
+    ColumnarFileWriter(const RecordSchema& s, size_t group_rows)
+        : record_schema(s), schema(arrow_schema(s)), row_group_rows(group_rows == 0 ? 1 : group_rows),
+          batch(record_schema), decoder(record_schema) {}
+
+    void decode_line(const char* line, size_t size) {
+        while (size > 0 && (line[size - 1] == '\r' || line[size - 1] == ' ')) --size;
+        if (size == 0) return;
+        std::string error;
+        if (!decoder.append_record(line, size, batch, &error)) throw std::runtime_error(error);
+        if (batch.num_rows >= row_group_rows) {
+            auto status = flush();
+            if (!status.ok()) throw std::runtime_error(status.ToString());
+        }
+    }
+
+    arrow::Status flush() {
+        if (batch.num_rows == 0) return arrow::Status::OK();
+        ARROW_ASSIGN_OR_RAISE(auto record_batch, to_arrow(batch, schema));
+        if (parquet_writer) ARROW_RETURN_NOT_OK(parquet_writer->WriteRecordBatch(*record_batch));
+        if (ipc_writer) ARROW_RETURN_NOT_OK(ipc_writer->WriteRecordBatch(*record_batch));
+        rows += batch.num_rows;
+        batch.clear();
+        return arrow::Status::OK();
+    }
+};
+
+// Streams a dataset as jsonl and writes it to path as Parquet or an Arrow IPC
+// file. Column types come from schema, or from get_dataset_info when schema
+// is empty. The file is written under a temporary name and renamed to path
+// once complete, so a failed export leaves no truncated file behind.
+// Resolves to the usual success/error object, with rows_written.
+inline pplx::task<json::value> export_dataset_columnar_file(
+    OpenDataSoftAPI& api,
+    const std::string& dataset_id,
+    const std::string& path,
+    ColumnarFileFormat format = ColumnarFileFormat::Parquet,
+    const RecordSchema& schema = RecordSchema(),
+    size_t row_group_rows = 64 * 1024,
+    const std::string& select = "",
+    const std::string& where = "",
+    const std::string& order_by = "",
+    int limit = -1,
+    const std::string& refine = "",
+    const std::string& exclude = "",
+    const std::string& lang = "",
+    const std::string& timezone = "") {
+
+    auto info = schema.fields.empty() ? api.get_dataset_info(dataset_id) : pplx::task_from_result(json::value::null());
+    OpenDataSoftAPI* client = &api;
+
+    return info.then([=](json::value dataset_info) {
+        auto error = [](const std::string& message) {
+            json::value error_obj;
+            error_obj[U("error")] = json::value::string(utility::conversions::to_string_t(message));
+            error_obj[U("success")] = json::value::boolean(false);
+            return error_obj;
+        };
+        // A failed get_dataset_info keeps its own error object
+        if (dataset_info.has_field(U("error"))) return pplx::task_from_result(dataset_info);
+        RecordSchema record_schema = schema.fields.empty() ? RecordSchema::from_dataset_info(dataset_info) : schema;
+        if (record_schema.fields.empty()) {
+            return pplx::task_from_result(error("Dataset schema has no fields"));
+        }
+
+        std::string temp_path = path + ".partial";
+        auto opened = ColumnarFileWriter::Open(temp_path, record_schema, format, row_group_rows);
+        if (!opened.ok()) {
+            std::remove(temp_path.c_str());
+            return pplx::task_from_result(error(opened.status().ToString()));
+        }
+        std::shared_ptr<ColumnarFileWriter> writer = *opened;
+
+        auto sink = [writer](const char* data, size_t size) { writer->write(data, size); };
+        return client->stream_export_dataset(dataset_id, "jsonl", sink, select, where, order_by, "", limit,
+                                             refine, exclude, lang, timezone)
+            .then([writer, error, path, temp_path](pplx::task<json::value> previousTask) {
+                auto discard = [&](const json::value& result) {
+                    writer->abort();
+                    std::remove(temp_path.c_str());
+                    return result;
+                };
+                json::value result;
+                try {
+                    result = previousTask.get();
+                } catch (const std::exception& e) {
+                    return discard(error(e.what()));
+                }
+                if (result.has_field(U("error"))) return discard(result);
+                arrow::Status status;
+                try {
+                    status = writer->close();
+                } catch (const std::exception& e) {
+                    return discard(error(e.what()));
+                }
+                if (!status.ok()) return discard(error(status.ToString()));
+                if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+                    std::remove(temp_path.c_str());
+                    return error("Failed to rename " + temp_path + " to " + path);
+                }
+                result[U("rows_written")] = json::value::number(writer->rows_written());
+                return result;
+            });
+    });
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef OPENDATASOFT_COROUTINE_H
+#define OPENDATASOFT_COROUTINE_H
+
+// Optional C++20 coroutine support. Every OpenDataSoftAPI call can be
+// co_awaited, and pplx::task<T> can be used as a coroutine return type:
+//
+//     pplx::task<json::value> latest(OpenDataSoftAPI& api, pplx::cancellation_token token) {
+//         OpenDataSoftAPI::Query query;
+//         query.order_by("date DESC").limit(1);
+//         co_return co_await api.query_dataset_records("my-dataset", query,
+//             OpenDataSoftAPI::CallOptions(token, std::chrono::seconds(5)));
+//     }
+//
+// Requires -std=c++20; the rest of the library stays C++11.
+
+#include "OpenDataSoftAPI.h"
+
+#if !defined(__cpp_impl_coroutine)
+#error "OpenDataSoftCoroutine.h requires a compiler with C++20 coroutine support"
+#endif
+
+#if defined(_WIN32) && !CPPREST_FORCE_PPLX
+// pplx is the Concurrency Runtime here, which ships its own co_await support
+#include <pplawait.h>
+#else
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+// A finished task does not suspend. Otherwise the coroutine is resumed
+// inline on the thread that completes the task, without another
+// scheduling hop.
+template <typename T>
+struct OpenDataSoftAwaiter {
+    pplx::task<T> task;
+
+    bool await_ready() const { return task.is_done(); }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        task.then([handle](pplx::task<T>) { handle.resume(); },
+                  pplx::task_continuation_context::use_synchronous_execution());
+    }
+
+    T await_resume() { return task.get(); }
+};
+
+template <typename T>
+struct OpenDataSoftPromiseBase {
+    pplx::task_completion_event<T> completion;
+
+    pplx::task<T> get_return_object() { return pplx::create_task(completion); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void unhandled_exception() { completion.set_exception(std::current_exception()); }
+};
+
+template <typename T>
+struct OpenDataSoftPromise : OpenDataSoftPromiseBase<T> {
+    void return_value(T value) { this->completion.set(std::move(value)); }
+};
+
+template <>
+struct OpenDataSoftPromise<void> : OpenDataSoftPromiseBase<void> {
+    void return_void() { this->completion.set(); }
+};
+
+// Declared in pplx so argument-dependent lookup finds it from any namespace
+namespace pplx {
+template <typename T>
+OpenDataSoftAwaiter<T> operator co_await(task<T> awaited) {
+    return OpenDataSoftAwaiter<T>{std::move(awaited)};
+}
+}
+
+namespace std {
+template <typename T, typename... Args>
+struct coroutine_traits<pplx::task<T>, Args...> {
+    typedef OpenDataSoftPromise<T> promise_type;
+};
+}
+#endif
+
+#endif
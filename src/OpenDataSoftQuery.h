@@ -0,0 +1,181 @@
+#ifndef OPENDATASOFT_QUERY_H
+#define OPENDATASOFT_QUERY_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstddef>
+
+// Query parameters for the Explore v2.1 endpoints. Values are
+// percent-encoded once, when they are set, and the query string is written
+// into the caller's buffer in a single pass, so a query can be built once
+// and reused for many requests. Equal queries produce identical strings and
+// hashes, which makes a query usable as a cache key.
+class OpenDataSoftQuery {
+public:
+    OpenDataSoftQuery& select(const std::string& value) { return set(Select, value); }
+    OpenDataSoftQuery& where(const std::string& value) { return set(Where, value); }
+    OpenDataSoftQuery& group_by(const std::string& value) { return set(GroupBy, value); }
+    OpenDataSoftQuery& order_by(const std::string& value) { return set(OrderBy, value); }
+    OpenDataSoftQuery& refine(const std::string& value) { return set(Refine, value); }
+    OpenDataSoftQuery& exclude(const std::string& value) { return set(Exclude, value); }
+    OpenDataSoftQuery& lang(const std::string& value) { return set(Lang, value); }
+    OpenDataSoftQuery& timezone(const std::string& value) { return set(Timezone, value); }
+
+    OpenDataSoftQuery& limit(int value) { return set(Limit, std::to_string(value)); }
+    OpenDataSoftQuery& offset(int value) { return set(Offset, std::to_string(value)); }
+
+    // Any other parameter (facet, delimiter, epsg, ...). Parameters added
+    // here may repeat and are written in the order they were added.
+    OpenDataSoftQuery& param(const std::string& name, const std::string& value) {
+        if (value.empty()) return *this;
+        std::string encoded;
+        encoded.reserve(name.size() + 1 + value.size());
+        encoded += name;
+        encoded += '=';
+        encode(value, encoded);
+        extras.push_back(std::move(encoded));
+        return *this;
+    }
+
+    OpenDataSoftQuery& flag(const std::string& name, bool value) {
+        return param(name, value ? "true" : "false");
+    }
+
+    void clear() {
+        for (auto& value : values) value.clear();
+        extras.clear();
+    }
+
+    bool empty() const {
+        for (const auto& value : values) if (!value.empty()) return false;
+        return extras.empty();
+    }
+
+    // Length of the query string including the leading '?', 0 when empty
+    size_t size() const {
+        size_t total = 0;
+        for (int i = 0; i < FieldCount; ++i) {
+            if (!values[i].empty()) total += 1 + std::char_traits<char>::length(field_name(i)) + 1 + values[i].size();
+        }
+        for (const auto& extra : extras) total += 1 + extra.size();
+        return total;
+    }
+
+    void append_to(std::string& out) const {
+        char separator = '?';
+        for (int i = 0; i < FieldCount; ++i) {
+            if (values[i].empty()) continue;
+            out += separator;
+            out += field_name(i);
+            out += '=';
+            out += values[i];
+            separator = '&';
+        }
+        for (const auto& extra : extras) {
+            out += separator;
+            out += extra;
+            separator = '&';
+        }
+    }
+
+    std::string str() const {
+        std::string out;
+        out.reserve(size());
+        append_to(out);
+        return out;
+    }
+
+    // path followed by the query string, built with one allocation
+    std::string endpoint(const std::string& path) const {
+        std::string out;
+        out.reserve(path.size() + size());
+        out += path;
+        append_to(out);
+        return out;
+    }
+
+    size_t hash() const {
+        size_t seed = 0;
+        std::hash<std::string> hasher;
+        for (int i = 0; i < FieldCount; ++i) combine(seed, hasher(values[i]));
+        for (const auto& extra : extras) combine(seed, hasher(extra));
+        return seed;
+    }
+
+    bool operator==(const OpenDataSoftQuery& other) const {
+        for (int i = 0; i < FieldCount; ++i) if (values[i] != other.values[i]) return false;
+        return extras == other.extras;
+    }
+
+    bool operator!=(const OpenDataSoftQuery& other) const { return !(*this == other); }
+
+    // Percent-encodes a UTF-8 string the way web::uri::encode_data_string
+    // does: everything except unreserved characters is escaped.
+    static void encode(const std::string& value, std::string& out) {
+        static const char hex[] = "0123456789ABCDEF";
+        for (unsigned char c : value) {
+            if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                c == '-' || c == '.' || c == '_' || c == '~') {
+                out += static_cast<char>(c);
+            } else {
+                out += '%';
+                out += hex[c >> 4];
+                out += hex[c & 0x0F];
+            }
+        }
+    }
+
+    static std::string encode(const std::string& value) {
+        std::string out;
+        out.reserve(value.size());
+        encode(value, out);
+        return out;
+    }
+
+private:
+    enum Field {
+        Select,
+        Where,
+        GroupBy,
+        OrderBy,
+        Limit,
+        Offset,
+        Refine,
+        Exclude,
+        Lang,
+        Timezone,
+        FieldCount
+    };
+
+    std::string values[FieldCount];
+    std::vector<std::string> extras;
+
+    static const char* field_name(int field) {
+        static const char* const names[FieldCount] = {
+            "select", "where", "group_by", "order_by", "limit", "offset",
+            "refine", "exclude", "lang", "timezone"
+        };
+        return names[field];
+    }
+
+    OpenDataSoftQuery& set(Field field, const std::string& value) {
+        values[field].clear();
+        encode(value, values[field]);
+        return *this;
+    }
+
+    static void combine(size_t& seed, size_t value) {
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+};
+
+namespace std {
+template <>
+struct hash<OpenDataSoftQuery> {
+    size_t operator()(const OpenDataSoftQuery& query) const { return query.hash(); }
+};
+}
+
+#endif
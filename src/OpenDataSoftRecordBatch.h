@@ -0,0 +1,653 @@
+#ifndef OPENDATASOFT_RECORD_BATCH_H
+#define OPENDATASOFT_RECORD_BATCH_H
+
+#include <cpprest/json.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+
+// Columnar view of dataset records. Field types come from the dataset
+// schema; each column stores its values contiguously with a validity byte
+// per row, so decoding a page costs a handful of vector appends instead of
+// one json::value node per key and value.
+enum class FieldType {
+    Text,
+    Integer,
+    Double,
+    Boolean,
+    Date,       // days since 1970-01-01
+    DateTime,   // milliseconds since 1970-01-01T00:00:00Z
+    GeoPoint    // lat/lon pair
+};
+
+struct FieldSchema {
+    std::string name;
+    FieldType type;
+};
+
+struct RecordSchema {
+    std::vector<FieldSchema> fields;
+
+    // Builds the schema from a get_dataset_info result. Field types the
+    // decoder has no column for (geo_shape, file, ...) are kept as Text
+    // holding the raw JSON of the value.
+    static RecordSchema from_dataset_info(const web::json::value& info) {
+        RecordSchema schema;
+        if (!info.has_field(U("fields"))) return schema;
+        for (const auto& field : info.at(U("fields")).as_array()) {
+            if (!field.has_field(U("name"))) continue;
+            FieldSchema column;
+            column.name = utility::conversions::to_utf8string(field.at(U("name")).as_string());
+            std::string type = field.has_field(U("type")) ? utility::conversions::to_utf8string(field.at(U("type")).as_string()) : "text";
+            if (type == "int") column.type = FieldType::Integer;
+            else if (type == "double") column.type = FieldType::Double;
+            else if (type == "boolean") column.type = FieldType::Boolean;
+            else if (type == "date") column.type = FieldType::Date;
+            else if (type == "datetime") column.type = FieldType::DateTime;
+            else if (type == "geo_point_2d") column.type = FieldType::GeoPoint;
+            else column.type = FieldType::Text;
+            schema.fields.push_back(column);
+        }
+        return schema;
+    }
+
+    int index_of(const char* name, size_t length) const {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (fields[i].name.size() == length && std::memcmp(fields[i].name.data(), name, length) == 0) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+};
+
+struct Column {
+    FieldSchema field;
+    std::vector<uint8_t> valid;
+    std::vector<int64_t> ints;       // Integer, Boolean, Date, DateTime
+    std::vector<double> doubles;     // Double; GeoPoint as lat, lon, lat, lon, ...
+    std::vector<int64_t> offsets;    // Text: row i is data[offsets[i], offsets[i + 1])
+    std::string data;                // Text arena
+
+    size_t size() const { return valid.size(); }
+
+    bool is_null(size_t row) const { return valid[row] == 0; }
+
+    std::string text(size_t row) const {
+        return data.substr(static_cast<size_t>(offsets[row]), static_cast<size_t>(offsets[row + 1] - offsets[row]));
+    }
+
+    void clear() {
+        valid.clear();
+        ints.clear();
+        doubles.clear();
+        data.clear();
+        offsets.assign(1, 0);
+    }
+};
+
+struct RecordBatch {
+    std::vector<Column> columns;
+    size_t num_rows = 0;
+    // Error object in the same shape OpenDataSoftAPI returns, or null
+    web::json::value error;
+
+    RecordBatch() {}
+
+    explicit RecordBatch(const RecordSchema& schema) {
+        for (const auto& field : schema.fields) {
+            Column column;
+            column.field = field;
+            column.offsets.assign(1, 0);
+            columns.push_back(column);
+        }
+    }
+
+    bool ok() const { return error.is_null(); }
+
+    int column_index(const std::string& name) const {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i].field.name == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Drops the rows but keeps the columns and their capacity
+    void clear() {
+        for (auto& column : columns) column.clear();
+        num_rows = 0;
+    }
+};
+
+// Single-pass pull parser that decodes JSON records straight into a
+// RecordBatch. Keys are matched against the schema without allocating;
+// fields missing from the schema are skipped, fields missing from a record
+// become nulls.
+class RecordBatchDecoder {
+public:
+    explicit RecordBatchDecoder(const RecordSchema& schema) : schema(schema), seen(schema.fields.size(), 0) {}
+
+    // Decodes a /records response ({"results": [...]}) or a /exports/json
+    // body ([...]), appending the records to batch.
+    bool decode_response(const char* data, size_t size, RecordBatch& batch, std::string* error = nullptr) {
+        begin = data;
+        pos = data;
+        end = data + size;
+        size_t rows = batch.num_rows;
+        bool ok = parse_response(batch);
+        if (!ok) fail(batch, rows, error);
+        return ok;
+    }
+
+    // Decodes a single JSON object, e.g. one line of an /exports/jsonl body
+    bool append_record(const char* data, size_t size, RecordBatch& batch, std::string* error = nullptr) {
+        begin = data;
+        pos = data;
+        end = data + size;
+        size_t rows = batch.num_rows;
+        skip_whitespace();
+        bool ok = parse_record(batch);
+        if (!ok) fail(batch, rows, error);
+        return ok;
+    }
+
+private:
+    const RecordSchema& schema;
+    const char* begin = nullptr;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    std::vector<uint32_t> seen;
+    uint32_t generation = 0;
+    int expected_field = 0;
+    std::string scratch;
+
+    // Drops a partially decoded record so every column has batch.num_rows rows
+    void fail(RecordBatch& batch, size_t rows, std::string* error) {
+        batch.num_rows = rows;
+        for (auto& column : batch.columns) {
+            column.valid.resize(rows);
+            switch (column.field.type) {
+            case FieldType::Double:
+                column.doubles.resize(rows);
+                break;
+            case FieldType::GeoPoint:
+                column.doubles.resize(rows * 2);
+                break;
+            case FieldType::Text:
+                column.offsets.resize(rows + 1);
+                column.data.resize(static_cast<size_t>(column.offsets.back()));
+                break;
+            default:
+                column.ints.resize(rows);
+                break;
+            }
+        }
+        if (error) *error = "Invalid JSON at byte " + std::to_string(pos - begin);
+    }
+
+    bool parse_response(RecordBatch& batch) {
+        skip_whitespace();
+        if (pos >= end) return false;
+        if (*pos == '[') return parse_records(batch);
+        if (!consume('{')) return false;
+        skip_whitespace();
+        if (consume('}')) return true;
+        while (true) {
+            skip_whitespace();
+            if (!parse_scratch()) return false;
+            skip_whitespace();
+            if (!consume(':')) return false;
+            skip_whitespace();
+            if (scratch == "results") {
+                if (!parse_records(batch)) return false;
+            } else if (!skip_value()) {
+                return false;
+            }
+            skip_whitespace();
+            if (consume(',')) continue;
+            return consume('}');
+        }
+    }
+
+    bool parse_records(RecordBatch& batch) {
+        if (!consume('[')) return false;
+        skip_whitespace();
+        if (consume(']')) return true;
+        while (true) {
+            skip_whitespace();
+            if (!parse_record(batch)) return false;
+            skip_whitespace();
+            if (consume(',')) continue;
+            return consume(']');
+        }
+    }
+
+    bool parse_record(RecordBatch& batch) {
+        if (!consume('{')) return false;
+        if (++generation == 0) {
+            std::fill(seen.begin(), seen.end(), 0);
+            generation = 1;
+        }
+        expected_field = 0;
+
+        skip_whitespace();
+        if (!consume('}')) {
+            while (true) {
+                skip_whitespace();
+                int field = parse_key();
+                if (field == -2) return false;
+                skip_whitespace();
+                if (!consume(':')) return false;
+                skip_whitespace();
+                if (field >= 0 && seen[field] != generation) {
+                    seen[field] = generation;
+                    if (!parse_field(batch.columns[field])) return false;
+                    expected_field = field + 1;
+                } else if (!skip_value()) {
+                    return false;
+                }
+                skip_whitespace();
+                if (consume(',')) continue;
+                if (consume('}')) break;
+                return false;
+            }
+        }
+
+        for (size_t i = 0; i < batch.columns.size(); ++i) {
+            if (seen[i] != generation) append_null(batch.columns[i]);
+        }
+        ++batch.num_rows;
+        return true;
+    }
+
+    // Returns the schema index of the key, -1 for unknown keys, -2 on error.
+    // Records usually repeat the schema's field order, so the field after the
+    // previous one is tried before scanning.
+    int parse_key() {
+        if (pos >= end || *pos != '"') return -2;
+        const char* start = pos + 1;
+        const char* p = start;
+        while (p < end && *p != '"' && *p != '\\') ++p;
+        if (p < end && *p == '"') {
+            pos = p + 1;
+            size_t length = p - start;
+            if (expected_field < static_cast<int>(schema.fields.size())) {
+                const auto& name = schema.fields[expected_field].name;
+                if (name.size() == length && std::memcmp(name.data(), start, length) == 0) return expected_field;
+            }
+            return schema.index_of(start, length);
+        }
+        if (!parse_scratch()) return -2;
+        return schema.index_of(scratch.data(), scratch.size());
+    }
+
+    bool parse_field(Column& column) {
+        if (pos >= end) return false;
+        if (match_literal("null")) {
+            append_null(column);
+            return true;
+        }
+        switch (column.field.type) {
+        case FieldType::Integer: {
+            int64_t value;
+            bool exact;
+            if (*pos != '-' && (*pos < '0' || *pos > '9')) return append_raw_or_null(column);
+            if (!parse_integer(value, exact)) return false;
+            if (!exact) {
+                append_null(column);
+                return true;
+            }
+            column.ints.push_back(value);
+            column.valid.push_back(1);
+            return true;
+        }
+        case FieldType::Double: {
+            double value;
+            if (*pos != '-' && (*pos < '0' || *pos > '9')) return append_raw_or_null(column);
+            if (!parse_number(value)) return false;
+            column.doubles.push_back(value);
+            column.valid.push_back(1);
+            return true;
+        }
+        case FieldType::Boolean: {
+            bool is_true = match_literal("true");
+            if (!is_true && !match_literal("false")) return append_raw_or_null(column);
+            column.ints.push_back(is_true ? 1 : 0);
+            column.valid.push_back(1);
+            return true;
+        }
+        case FieldType::Date:
+        case FieldType::DateTime: {
+            if (*pos != '"') return append_raw_or_null(column);
+            if (!parse_scratch()) return false;
+            int64_t value;
+            bool parsed = column.field.type == FieldType::Date ? parse_date(scratch, value) : parse_datetime(scratch, value);
+            column.ints.push_back(parsed ? value : 0);
+            column.valid.push_back(parsed ? 1 : 0);
+            return true;
+        }
+        case FieldType::GeoPoint:
+            return parse_geo_point(column);
+        case FieldType::Text:
+        default:
+            if (*pos == '"') {
+                if (!parse_string(column.data)) return false;
+            } else {
+                const char* start = pos;
+                if (!skip_value()) return false;
+                column.data.append(start, pos - start);
+            }
+            column.offsets.push_back(static_cast<int64_t>(column.data.size()));
+            column.valid.push_back(1);
+            return true;
+        }
+    }
+
+    // A value of an unexpected JSON type is stored as null
+    bool append_raw_or_null(Column& column) {
+        if (!skip_value()) return false;
+        append_null(column);
+        return true;
+    }
+
+    static void append_null(Column& column) {
+        switch (column.field.type) {
+        case FieldType::Double:
+            column.doubles.push_back(0);
+            break;
+        case FieldType::GeoPoint:
+            column.doubles.push_back(0);
+            column.doubles.push_back(0);
+            break;
+        case FieldType::Text:
+            column.offsets.push_back(static_cast<int64_t>(column.data.size()));
+            break;
+        default:
+            column.ints.push_back(0);
+            break;
+        }
+        column.valid.push_back(0);
+    }
+
+    // {"lon": x, "lat": y}
+    bool parse_geo_point(Column& column) {
+        if (*pos != '{') return append_raw_or_null(column);
+        ++pos;
+        double lat = 0, lon = 0;
+        int found = 0;
+        skip_whitespace();
+        if (!consume('}')) {
+            while (true) {
+                skip_whitespace();
+                if (!parse_scratch()) return false;
+                skip_whitespace();
+                if (!consume(':')) return false;
+                skip_whitespace();
+                if ((scratch == "lat" || scratch == "lon") && pos < end && *pos != 'n') {
+                    double value;
+                    if (!parse_number(value)) return false;
+                    if (scratch == "lat") lat = value;
+                    else lon = value;
+                    ++found;
+                } else if (!skip_value()) {
+                    return false;
+                }
+                skip_whitespace();
+                if (consume(',')) continue;
+                if (consume('}')) break;
+                return false;
+            }
+        }
+        column.doubles.push_back(lat);
+        column.doubles.push_back(lon);
+        column.valid.push_back(found == 2 ? 1 : 0);
+        return true;
+    }
+
+    bool parse_number(double& value) {
+        char buffer[64];
+        const char* start = pos;
+        while (pos < end && (std::strchr("+-.eE", *pos) != nullptr || (*pos >= '0' && *pos <= '9'))) ++pos;
+        size_t length = pos - start;
+        if (length == 0 || length >= sizeof(buffer)) return false;
+        std::memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        char* parsed_end;
+        value = std::strtod(buffer, &parsed_end);
+        return parsed_end == buffer + length;
+    }
+
+    // Parses a JSON number into an int64. Plain integers go through strtoll
+    // so values above 2^53 keep every digit; other forms are accepted only
+    // when they are whole numbers in range (e.g. 1e3). exact is false for
+    // fractional or out-of-range numbers, which are consumed but not stored.
+    bool parse_integer(int64_t& value, bool& exact) {
+        char buffer[64];
+        const char* start = pos;
+        while (pos < end && (std::strchr("+-.eE", *pos) != nullptr || (*pos >= '0' && *pos <= '9'))) ++pos;
+        size_t length = pos - start;
+        if (length == 0 || length >= sizeof(buffer)) return false;
+        std::memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        char* parsed_end;
+        exact = true;
+        if (std::strpbrk(buffer, ".eE") == nullptr) {
+            errno = 0;
+            value = std::strtoll(buffer, &parsed_end, 10);
+            if (errno == ERANGE) exact = false;
+            return parsed_end == buffer + length;
+        }
+        double number = std::strtod(buffer, &parsed_end);
+        if (parsed_end != buffer + length) return false;
+        // 2^63 is exactly representable; anything at or above it overflows
+        if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0) || std::floor(number) != number) {
+            exact = false;
+            value = 0;
+            return true;
+        }
+        value = static_cast<int64_t>(number);
+        return true;
+    }
+
+    bool parse_scratch() {
+        scratch.clear();
+        return parse_string(scratch);
+    }
+
+    // Appends the unescaped contents of the string at pos to out
+    bool parse_string(std::string& out) {
+        if (!consume('"')) return false;
+        while (pos < end) {
+            const char* start = pos;
+            while (pos < end && *pos != '"' && *pos != '\\') ++pos;
+            out.append(start, pos - start);
+            if (pos >= end) return false;
+            if (*pos == '"') {
+                ++pos;
+                return true;
+            }
+            if (++pos >= end) return false;
+            char escaped = *pos++;
+            switch (escaped) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (!parse_hex4(code)) return false;
+                if (code >= 0xD800 && code <= 0xDBFF && end - pos >= 6 && pos[0] == '\\' && pos[1] == 'u') {
+                    pos += 2;
+                    uint32_t low;
+                    if (!parse_hex4(low)) return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, code);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool parse_hex4(uint32_t& code) {
+        if (end - pos < 4) return false;
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = *pos++;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    static void append_utf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool skip_value() {
+        if (pos >= end) return false;
+        if (*pos == '"') {
+            ++pos;
+            while (pos < end && *pos != '"') {
+                if (*pos == '\\') ++pos;
+                ++pos;
+            }
+            if (pos >= end) return false;
+            ++pos;
+            return true;
+        }
+        if (*pos == '{' || *pos == '[') {
+            int depth = 0;
+            while (pos < end) {
+                char c = *pos;
+                if (c == '"') {
+                    if (!skip_value()) return false;
+                    continue;
+                }
+                ++pos;
+                if (c == '{' || c == '[') ++depth;
+                else if ((c == '}' || c == ']') && --depth == 0) return true;
+            }
+            return false;
+        }
+        const char* start = pos;
+        while (pos < end && *pos != ',' && *pos != '}' && *pos != ']' &&
+               *pos != ' ' && *pos != '\n' && *pos != '\r' && *pos != '\t') {
+            ++pos;
+        }
+        return pos > start;
+    }
+
+    bool match_literal(const char* literal) {
+        size_t length = std::strlen(literal);
+        if (static_cast<size_t>(end - pos) < length || std::memcmp(pos, literal, length) != 0) return false;
+        pos += length;
+        return true;
+    }
+
+    bool consume(char c) {
+        if (pos < end && *pos == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void skip_whitespace() {
+        while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) ++pos;
+    }
+
+public:
+    // Days since 1970-01-01 for a proleptic Gregorian date
+    static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        const int64_t era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned yoe = static_cast<unsigned>(y - era * 400);
+        const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<int64_t>(doe) - 719468;
+    }
+
+    static bool read_digits(const std::string& text, size_t offset, size_t count, int& value) {
+        if (text.size() < offset + count) return false;
+        value = 0;
+        for (size_t i = offset; i < offset + count; ++i) {
+            if (text[i] < '0' || text[i] > '9') return false;
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    }
+
+    // YYYY-MM-DD
+    static bool parse_date(const std::string& text, int64_t& days) {
+        int year, month, day;
+        if (!read_digits(text, 0, 4, year) || text.size() < 10 || text[4] != '-' || text[7] != '-' ||
+            !read_digits(text, 5, 2, month) || !read_digits(text, 8, 2, day)) {
+            return false;
+        }
+        days = days_from_civil(year, month, day);
+        return true;
+    }
+
+    // YYYY-MM-DDTHH:MM:SS[.fff][Z|+HH:MM|-HH:MM]
+    static bool parse_datetime(const std::string& text, int64_t& millis) {
+        int64_t days;
+        int hour, minute, second;
+        if (!parse_date(text, days)) return false;
+        if (text.size() < 19 || (text[10] != 'T' && text[10] != ' ') || text[13] != ':' || text[16] != ':' ||
+            !read_digits(text, 11, 2, hour) || !read_digits(text, 14, 2, minute) || !read_digits(text, 17, 2, second)) {
+            return false;
+        }
+        millis = ((days * 24 + hour) * 60 + minute) * 60000 + second * 1000;
+
+        size_t i = 19;
+        if (i < text.size() && text[i] == '.') {
+            int scale = 100;
+            for (++i; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+                millis += (text[i] - '0') * scale;
+                scale /= 10;
+            }
+        }
+        if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+            int offset_hours, offset_minutes;
+            if (!read_digits(text, i + 1, 2, offset_hours) || text.size() < i + 6 ||
+                !read_digits(text, i + 4, 2, offset_minutes)) {
+                return false;
+            }
+            int64_t offset = (offset_hours * 60 + offset_minutes) * 60000;
+            millis += text[i] == '+' ? -offset : offset;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,1074 @@
+#ifndef OPENDATASOFT_REPLICA_H
+#define OPENDATASOFT_REPLICA_H
+
+#include "OpenDataSoftAPI.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+
+// In-process, read-only copy of one dataset. load() pulls the dataset once
+// through /exports/json into columnar storage and indexes it: a hash index
+// per text, integer and boolean field (refine, exclude, equality) and a
+// sorted index per numeric, date and datetime field (range filters).
+//
+// query_dataset_records and get_dataset_facets answer locally when the query
+// is within the supported subset and fall back to the remote API otherwise:
+//   select    *, fields, count(*), count/sum/avg/min/max(field), "as" aliases
+//   where     field op literal with = != <> < <= > >=, IS [NOT] NULL,
+//             AND / OR / NOT and parentheses
+//   group_by  plain fields
+//   order_by  fields or select aliases, ASC / DESC
+//   refine / exclude  field:value on text, integer and boolean fields
+// lang and timezone (other than UTC) always go to the remote API. Results
+// reflect the rows loaded; call load() again to refresh.
+class OpenDataSoftReplica {
+public:
+    OpenDataSoftReplica(OpenDataSoftAPI& api, const std::string& dataset_id)
+        : api(&api), dataset_id(dataset_id) {}
+
+    // Downloads the dataset (or the rows matching where) and builds the
+    // indexes. The schema comes from get_dataset_info when empty. Queries
+    // keep using the previous copy until the new one is ready.
+    pplx::task<json::value> load(const RecordSchema& schema = RecordSchema(), const std::string& where = "") {
+        auto resolved = schema.fields.empty() ? api->get_dataset_info(dataset_id) : pplx::task_from_result(json::value::null());
+        OpenDataSoftAPI* client = api;
+        std::string id = dataset_id;
+        auto shared = state;
+
+        return resolved.then([client, id, schema, where, shared](json::value info) {
+            if (info.is_object() && info.has_field(U("error"))) return pplx::task_from_result(info);
+
+            auto store = std::make_shared<Store>();
+            RecordSchema record_schema = schema;
+            if (record_schema.fields.empty()) {
+                record_schema = RecordSchema::from_dataset_info(info);
+                store->raw_json = raw_json_fields(info, record_schema);
+            } else {
+                store->raw_json.assign(record_schema.fields.size(), false);
+            }
+            if (record_schema.fields.empty()) return pplx::task_from_result(error(U("Dataset schema has no fields")));
+
+            return client->export_dataset_columnar(id, record_schema, "", where)
+                .then([store, shared](std::shared_ptr<RecordBatch> batch) {
+                    if (!batch->ok()) return batch->error;
+                    store->batch = std::move(*batch);
+                    store->build_indexes();
+                    {
+                        std::lock_guard<std::mutex> lock(shared->mutex);
+                        shared->store = store;
+                    }
+                    json::value result;
+                    result[U("success")] = json::value::boolean(true);
+                    result[U("records")] = json::value::number(static_cast<uint64_t>(store->batch.num_rows));
+                    return result;
+                });
+        });
+    }
+
+    bool loaded() const { return snapshot() != nullptr; }
+
+    size_t size() const {
+        auto store = snapshot();
+        return store ? store->batch.num_rows : 0;
+    }
+
+    uint64_t local_queries() const { return state->local; }
+    uint64_t remote_queries() const { return state->remote; }
+
+    pplx::task<json::value> query_dataset_records(
+        const std::string& select = "",
+        const std::string& where = "",
+        const std::string& group_by = "",
+        const std::string& order_by = "",
+        int limit = 10,
+        int offset = 0,
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& lang = "",
+        const std::string& timezone = "") {
+
+        json::value result;
+        if (try_query_records(select, where, group_by, order_by, limit, offset, refine, exclude, lang, timezone, result)) {
+            ++state->local;
+            return pplx::task_from_result(result);
+        }
+        ++state->remote;
+        return api->query_dataset_records(dataset_id, select, where, group_by, order_by, limit, offset, refine, exclude, lang, timezone);
+    }
+
+    pplx::task<json::value> get_dataset_facets(
+        const std::string& where = "",
+        const std::string& refine = "",
+        const std::string& exclude = "",
+        const std::string& facet = "",
+        const std::string& lang = "",
+        const std::string& timezone = "") {
+
+        json::value result;
+        if (try_facets(where, refine, exclude, facet, lang, timezone, result)) {
+            ++state->local;
+            return pplx::task_from_result(result);
+        }
+        ++state->remote;
+        return api->get_dataset_facets(dataset_id, where, refine, exclude, facet, lang, timezone);
+    }
+
+    // Local evaluation only. Returns false, leaving result untouched, when
+    // nothing is loaded or the query is outside the supported subset.
+    bool try_query_records(
+        const std::string& select,
+        const std::string& where,
+        const std::string& group_by,
+        const std::string& order_by,
+        int limit,
+        int offset,
+        const std::string& refine,
+        const std::string& exclude,
+        const std::string& lang,
+        const std::string& timezone,
+        json::value& result) const {
+
+        auto store = snapshot();
+        if (!store || !local_options(lang, timezone)) return false;
+
+        Rows rows;
+        if (!store->filter(where, refine, exclude, rows)) return false;
+
+        std::vector<SelectItem> items;
+        if (!parse_select(*store, select, items)) return false;
+        std::vector<int> groups;
+        if (!parse_fields(*store, group_by, groups)) return false;
+        bool aggregated = !groups.empty();
+        for (const auto& item : items) aggregated = aggregated || item.aggregate != None;
+        if (items.empty()) {
+            if (aggregated) {
+                for (int column : groups) items.push_back(SelectItem(store->batch.columns[column].field.name, column, None));
+            } else {
+                items.push_back(SelectItem("*", -1, None));
+            }
+        }
+
+        std::vector<SortKey> sort_keys;
+        if (!parse_order_by(*store, order_by, items, aggregated, sort_keys)) return false;
+
+        json::value results = json::value::array();
+        size_t total;
+        if (aggregated) {
+            if (!store->aggregate(rows, items, groups, sort_keys, limit, offset, results, total)) return false;
+        } else {
+            store->project(rows, items, sort_keys, limit, offset, results);
+            total = rows.size();
+        }
+
+        result = json::value::object();
+        result[U("total_count")] = json::value::number(static_cast<uint64_t>(total));
+        result[U("results")] = results;
+        return true;
+    }
+
+    bool try_facets(
+        const std::string& where,
+        const std::string& refine,
+        const std::string& exclude,
+        const std::string& facet,
+        const std::string& lang,
+        const std::string& timezone,
+        json::value& result) const {
+
+        auto store = snapshot();
+        if (!store || !local_options(lang, timezone) || facet.empty()) return false;
+        int column = store->batch.column_index(trim(facet));
+        if (column < 0 || !store->has_hash_index(column)) return false;
+
+        Rows rows;
+        if (!store->filter(where, refine, exclude, rows)) return false;
+
+        std::unordered_map<std::string, uint64_t> counts;
+        const Column& values = store->batch.columns[column];
+        for (uint32_t row : rows) {
+            if (!values.is_null(row)) ++counts[store->key(column, row)];
+        }
+        std::vector<std::pair<std::string, uint64_t>> ordered(counts.begin(), counts.end());
+        std::sort(ordered.begin(), ordered.end(), [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+
+        json::value entries = json::value::array();
+        for (size_t i = 0; i < ordered.size(); ++i) {
+            json::value entry;
+            auto value = utility::conversions::to_string_t(ordered[i].first);
+            entry[U("name")] = json::value::string(value);
+            entry[U("count")] = json::value::number(ordered[i].second);
+            entry[U("state")] = json::value::string(U("displayed"));
+            entry[U("value")] = json::value::string(value);
+            entries[i] = entry;
+        }
+        json::value group;
+        group[U("name")] = json::value::string(utility::conversions::to_string_t(values.field.name));
+        group[U("facets")] = entries;
+
+        result = json::value::object();
+        result[U("links")] = json::value::array();
+        result[U("facets")] = json::value::array(1);
+        result[U("facets")][0] = group;
+        return true;
+    }
+
+private:
+    typedef std::vector<uint32_t> Rows;    // always sorted, no duplicates
+
+    enum Aggregate { None, Count, CountAll, Sum, Avg, Min, Max };
+
+    struct SelectItem {
+        std::string name;    // output key
+        int column;          // -1 for count(*) and *
+        Aggregate aggregate;
+
+        SelectItem() : column(-1), aggregate(None) {}
+        SelectItem(const std::string& n, int c, Aggregate a) : name(n), column(c), aggregate(a) {}
+    };
+
+    // Sorts on a column of the row, or on an output item of an aggregation
+    struct SortKey {
+        int column;
+        int item;
+        bool descending;
+    };
+
+    // A comparable cell: number, text or null
+    struct Cell {
+        bool null = true;
+        bool is_text = false;
+        double number = 0;
+        std::string text;
+
+        bool operator<(const Cell& other) const {
+            if (null != other.null) return !null;    // nulls last
+            if (null) return false;
+            if (is_text != other.is_text) return !is_text;
+            return is_text ? text < other.text : number < other.number;
+        }
+    };
+
+    struct Token {
+        enum Kind { End, Identifier, String, Number, Operator, LeftParen, RightParen, Comma };
+        Kind kind;
+        std::string text;
+    };
+
+    struct Store {
+        RecordBatch batch;
+        std::vector<bool> raw_json;    // Text columns holding raw JSON of other field types
+        std::vector<std::unordered_map<std::string, Rows>> hash_indexes;
+        std::vector<Rows> sorted_indexes;    // non-null rows ordered by value
+
+        bool has_hash_index(int column) const {
+            FieldType type = batch.columns[column].field.type;
+            return !raw_json[column] && (type == FieldType::Text || type == FieldType::Integer || type == FieldType::Boolean);
+        }
+
+        bool has_sorted_index(int column) const {
+            FieldType type = batch.columns[column].field.type;
+            return type == FieldType::Integer || type == FieldType::Double || type == FieldType::Date || type == FieldType::DateTime;
+        }
+
+        std::string key(int column, uint32_t row) const {
+            const Column& values = batch.columns[column];
+            switch (values.field.type) {
+            case FieldType::Text: return values.text(row);
+            case FieldType::Boolean: return values.ints[row] ? "true" : "false";
+            default: return std::to_string(values.ints[row]);
+            }
+        }
+
+        double number(int column, uint32_t row) const {
+            const Column& values = batch.columns[column];
+            return values.field.type == FieldType::Double ? values.doubles[row] : static_cast<double>(values.ints[row]);
+        }
+
+        void build_indexes() {
+            size_t columns = batch.columns.size();
+            hash_indexes.assign(columns, std::unordered_map<std::string, Rows>());
+            sorted_indexes.assign(columns, Rows());
+            for (size_t c = 0; c < columns; ++c) {
+                int column = static_cast<int>(c);
+                const Column& values = batch.columns[c];
+                if (has_hash_index(column)) {
+                    for (uint32_t row = 0; row < batch.num_rows; ++row) {
+                        if (!values.is_null(row)) hash_indexes[c][key(column, row)].push_back(row);
+                    }
+                }
+                if (has_sorted_index(column)) {
+                    Rows& sorted = sorted_indexes[c];
+                    for (uint32_t row = 0; row < batch.num_rows; ++row) {
+                        if (!values.is_null(row)) sorted.push_back(row);
+                    }
+                    std::stable_sort(sorted.begin(), sorted.end(), [this, column](uint32_t a, uint32_t b) {
+                        return number(column, a) < number(column, b);
+                    });
+                }
+            }
+        }
+
+        Rows all_rows() const {
+            Rows rows(batch.num_rows);
+            std::iota(rows.begin(), rows.end(), 0u);
+            return rows;
+        }
+
+        Rows non_null_rows(int column) const {
+            const Column& values = batch.columns[column];
+            Rows rows;
+            for (uint32_t row = 0; row < batch.num_rows; ++row) {
+                if (!values.is_null(row)) rows.push_back(row);
+            }
+            return rows;
+        }
+
+        bool filter(const std::string& where, const std::string& refine, const std::string& exclude, Rows& rows) const {
+            rows = all_rows();
+            if (!trim(where).empty()) {
+                std::vector<Token> tokens;
+                if (!tokenize(where, tokens)) return false;
+                size_t pos = 0;
+                Rows matched;
+                if (!parse_or(tokens, pos, matched) || tokens[pos].kind != Token::End) return false;
+                rows.swap(matched);
+            }
+            if (!trim(refine).empty()) {
+                Rows matched;
+                if (!facet_rows(refine, matched)) return false;
+                rows = intersect(rows, matched);
+            }
+            if (!trim(exclude).empty()) {
+                Rows matched;
+                if (!facet_rows(exclude, matched)) return false;
+                rows = difference(rows, matched);
+            }
+            return true;
+        }
+
+        // field:value, value optionally quoted
+        bool facet_rows(const std::string& expression, Rows& rows) const {
+            size_t colon = expression.find(':');
+            if (colon == std::string::npos) return false;
+            int column = batch.column_index(trim(expression.substr(0, colon)));
+            if (column < 0 || !has_hash_index(column)) return false;
+            std::string value = trim(expression.substr(colon + 1));
+            if (value.size() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0]) {
+                value = value.substr(1, value.size() - 2);
+            }
+            if (batch.columns[column].field.type == FieldType::Integer) {
+                char* end = nullptr;
+                long long number = std::strtoll(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0') return false;
+                value = std::to_string(number);
+            }
+            auto it = hash_indexes[column].find(value);
+            rows = it == hash_indexes[column].end() ? Rows() : it->second;
+            return true;
+        }
+
+        // Conditions follow SQL's three-valued logic: a comparison on a null
+        // field is unknown, neither true nor false. rows receives the rows
+        // where the condition is true; when known is given it also receives
+        // the rows where it is true or false, which NOT needs so that
+        // NOT x = 5 excludes null rows just as x != 5 does.
+        bool parse_or(const std::vector<Token>& tokens, size_t& pos, Rows& rows, Rows* known = nullptr) const {
+            Rows left_known;
+            if (!parse_and(tokens, pos, rows, known ? &left_known : nullptr)) return false;
+            Rows falsehood = known ? difference(left_known, rows) : Rows();
+            while (keyword(tokens[pos], "OR")) {
+                ++pos;
+                Rows right, right_known;
+                if (!parse_and(tokens, pos, right, known ? &right_known : nullptr)) return false;
+                rows = unite(rows, right);
+                if (known) falsehood = intersect(falsehood, difference(right_known, right));
+            }
+            if (known) *known = unite(rows, falsehood);
+            return true;
+        }
+
+        bool parse_and(const std::vector<Token>& tokens, size_t& pos, Rows& rows, Rows* known = nullptr) const {
+            Rows left_known;
+            if (!parse_unary(tokens, pos, rows, known ? &left_known : nullptr)) return false;
+            Rows falsehood = known ? difference(left_known, rows) : Rows();
+            while (keyword(tokens[pos], "AND")) {
+                ++pos;
+                Rows right, right_known;
+                if (!parse_unary(tokens, pos, right, known ? &right_known : nullptr)) return false;
+                rows = intersect(rows, right);
+                if (known) falsehood = unite(falsehood, difference(right_known, right));
+            }
+            if (known) *known = unite(rows, falsehood);
+            return true;
+        }
+
+        bool parse_unary(const std::vector<Token>& tokens, size_t& pos, Rows& rows, Rows* known = nullptr) const {
+            if (keyword(tokens[pos], "NOT")) {
+                ++pos;
+                Rows inner, inner_known;
+                if (!parse_unary(tokens, pos, inner, &inner_known)) return false;
+                rows = difference(inner_known, inner);
+                if (known) known->swap(inner_known);
+                return true;
+            }
+            if (tokens[pos].kind == Token::LeftParen) {
+                ++pos;
+                if (!parse_or(tokens, pos, rows, known) || tokens[pos].kind != Token::RightParen) return false;
+                ++pos;
+                return true;
+            }
+            return parse_comparison(tokens, pos, rows, known);
+        }
+
+        bool parse_comparison(const std::vector<Token>& tokens, size_t& pos, Rows& rows, Rows* known = nullptr) const {
+            if (tokens[pos].kind != Token::Identifier) return false;
+            int column = batch.column_index(tokens[pos].text);
+            if (column < 0) return false;
+            ++pos;
+
+            if (keyword(tokens[pos], "IS")) {
+                ++pos;
+                bool negate = keyword(tokens[pos], "NOT");
+                if (negate) ++pos;
+                if (!keyword(tokens[pos], "NULL")) return false;
+                ++pos;
+                const Column& values = batch.columns[column];
+                rows.clear();
+                for (uint32_t row = 0; row < batch.num_rows; ++row) {
+                    if (values.is_null(row) != negate) rows.push_back(row);
+                }
+                if (known) *known = all_rows();
+                return true;
+            }
+
+            if (tokens[pos].kind != Token::Operator) return false;
+            std::string op = tokens[pos].text == "<>" ? "!=" : tokens[pos].text;
+            ++pos;
+            const Token& literal = tokens[pos];
+            if (literal.kind != Token::String && literal.kind != Token::Number && literal.kind != Token::Identifier) return false;
+            ++pos;
+            if (!compare(column, op, literal, rows)) return false;
+            if (known) *known = non_null_rows(column);
+            return true;
+        }
+
+        bool compare(int column, const std::string& op, const Token& literal, Rows& rows) const {
+            const Column& values = batch.columns[column];
+            FieldType type = values.field.type;
+            if (raw_json[column] || type == FieldType::GeoPoint) return false;
+
+            if (op == "!=") {
+                Rows equal;
+                if (!compare(column, "=", literal, equal)) return false;
+                rows = difference(non_null_rows(column), equal);
+                return true;
+            }
+
+            if (type == FieldType::Text) {
+                if (literal.kind != Token::String) return false;
+                if (op == "=") return lookup(column, literal.text, rows);
+                rows.clear();
+                for (uint32_t row = 0; row < batch.num_rows; ++row) {
+                    if (!values.is_null(row) && holds(op, values.text(row).compare(literal.text))) rows.push_back(row);
+                }
+                return true;
+            }
+
+            if (type == FieldType::Boolean) {
+                if (op != "=" || literal.kind != Token::Identifier) return false;
+                if (!keyword(literal, "TRUE") && !keyword(literal, "FALSE")) return false;
+                return lookup(column, keyword(literal, "TRUE") ? "true" : "false", rows);
+            }
+
+            double bound;
+            if (!literal_number(type, literal, bound)) return false;
+            const Rows& sorted = sorted_indexes[column];
+            auto below = [this, column](uint32_t row, double value) { return number(column, row) < value; };
+            auto above = [this, column](double value, uint32_t row) { return value < number(column, row); };
+            Rows::const_iterator first = sorted.begin(), last = sorted.end();
+            if (op == "=") {
+                first = std::lower_bound(sorted.begin(), sorted.end(), bound, below);
+                last = std::upper_bound(first, sorted.end(), bound, above);
+            } else if (op == "<") {
+                last = std::lower_bound(sorted.begin(), sorted.end(), bound, below);
+            } else if (op == "<=") {
+                last = std::upper_bound(sorted.begin(), sorted.end(), bound, above);
+            } else if (op == ">") {
+                first = std::upper_bound(sorted.begin(), sorted.end(), bound, above);
+            } else if (op == ">=") {
+                first = std::lower_bound(sorted.begin(), sorted.end(), bound, below);
+            } else {
+                return false;
+            }
+            rows.assign(first, last);
+            std::sort(rows.begin(), rows.end());
+            return true;
+        }
+
+        bool lookup(int column, const std::string& key, Rows& rows) const {
+            auto it = hash_indexes[column].find(key);
+            rows = it == hash_indexes[column].end() ? Rows() : it->second;
+            return true;
+        }
+
+        static bool literal_number(FieldType type, const Token& literal, double& value) {
+            if (type == FieldType::Date || type == FieldType::DateTime) {
+                if (literal.kind != Token::String) return false;
+                int64_t parsed;
+                if (type == FieldType::DateTime && literal.text.size() > 10) {
+                    if (!RecordBatchDecoder::parse_datetime(literal.text, parsed)) return false;
+                } else {
+                    if (!RecordBatchDecoder::parse_date(literal.text, parsed)) return false;
+                    if (type == FieldType::DateTime) parsed *= 86400000;
+                }
+                value = static_cast<double>(parsed);
+                return true;
+            }
+            if (literal.kind != Token::Number) return false;
+            value = std::strtod(literal.text.c_str(), nullptr);
+            return true;
+        }
+
+        static bool holds(const std::string& op, int order) {
+            if (op == "<") return order < 0;
+            if (op == "<=") return order <= 0;
+            if (op == ">") return order > 0;
+            if (op == ">=") return order >= 0;
+            return false;
+        }
+
+        Cell cell(int column, uint32_t row) const {
+            Cell result;
+            const Column& values = batch.columns[column];
+            if (values.is_null(row)) return result;
+            result.null = false;
+            if (values.field.type == FieldType::Text) {
+                result.is_text = true;
+                result.text = values.text(row);
+            } else if (values.field.type != FieldType::GeoPoint) {
+                result.number = number(column, row);
+            }
+            return result;
+        }
+
+        json::value render(int column, uint32_t row) const {
+            const Column& values = batch.columns[column];
+            if (values.is_null(row)) return json::value::null();
+            switch (values.field.type) {
+            case FieldType::Integer:
+                return json::value::number(values.ints[row]);
+            case FieldType::Double:
+                return json::value::number(values.doubles[row]);
+            case FieldType::Boolean:
+                return json::value::boolean(values.ints[row] != 0);
+            case FieldType::Date:
+                return json::value::string(utility::conversions::to_string_t(format_date(values.ints[row])));
+            case FieldType::DateTime:
+                return json::value::string(utility::conversions::to_string_t(format_datetime(values.ints[row])));
+            case FieldType::GeoPoint: {
+                json::value point;
+                point[U("lon")] = json::value::number(values.doubles[2 * row + 1]);
+                point[U("lat")] = json::value::number(values.doubles[2 * row]);
+                return point;
+            }
+            case FieldType::Text:
+            default:
+                if (raw_json[column]) {
+                    try {
+                        return json::value::parse(utility::conversions::to_string_t(values.text(row)));
+                    } catch (const std::exception&) {
+                    }
+                }
+                return json::value::string(utility::conversions::to_string_t(values.text(row)));
+            }
+        }
+
+        void project(const Rows& rows, const std::vector<SelectItem>& items, const std::vector<SortKey>& sort_keys,
+                     int limit, int offset, json::value& results) const {
+            Rows ordered = rows;
+            if (!sort_keys.empty()) {
+                std::stable_sort(ordered.begin(), ordered.end(), [&](uint32_t a, uint32_t b) {
+                    for (const auto& key : sort_keys) {
+                        Cell left = cell(key.column, a), right = cell(key.column, b);
+                        if (left < right) return !key.descending;
+                        if (right < left) return key.descending;
+                    }
+                    return false;
+                });
+            }
+            size_t begin, end;
+            page(ordered.size(), limit, offset, begin, end);
+            for (size_t i = begin; i < end; ++i) {
+                json::value record = json::value::object();
+                for (const auto& item : items) {
+                    if (item.column < 0) {
+                        for (size_t c = 0; c < batch.columns.size(); ++c) {
+                            record[utility::conversions::to_string_t(batch.columns[c].field.name)] = render(static_cast<int>(c), ordered[i]);
+                        }
+                    } else {
+                        record[utility::conversions::to_string_t(item.name)] = render(item.column, ordered[i]);
+                    }
+                }
+                results[i - begin] = record;
+            }
+        }
+
+        bool aggregate(const Rows& rows, const std::vector<SelectItem>& items, const std::vector<int>& groups,
+                       const std::vector<SortKey>& sort_keys, int limit, int offset, json::value& results, size_t& total) const {
+            // Every selected plain field must be grouped on
+            for (const auto& item : items) {
+                if (item.aggregate == None && (item.column < 0 || std::find(groups.begin(), groups.end(), item.column) == groups.end())) return false;
+            }
+
+            struct Group {
+                uint32_t first_row;
+                std::vector<double> sums;
+                std::vector<uint64_t> counts;
+                std::vector<Cell> minimums;
+                std::vector<Cell> maximums;
+            };
+            std::vector<Group> found;
+            std::unordered_map<std::string, size_t> index;
+            std::string group_key;
+            for (uint32_t row : rows) {
+                group_key.clear();
+                for (int column : groups) {
+                    group_key += batch.columns[column].is_null(row) ? std::string("\x01") : "\x02" + key_text(column, row);
+                    group_key += '\x00';
+                }
+                auto it = index.find(group_key);
+                if (it == index.end()) {
+                    it = index.insert(std::make_pair(group_key, found.size())).first;
+                    Group group;
+                    group.first_row = row;
+                    group.sums.assign(items.size(), 0);
+                    group.counts.assign(items.size(), 0);
+                    group.minimums.assign(items.size(), Cell());
+                    group.maximums.assign(items.size(), Cell());
+                    found.push_back(group);
+                }
+                Group& group = found[it->second];
+                for (size_t i = 0; i < items.size(); ++i) {
+                    const SelectItem& item = items[i];
+                    if (item.aggregate == CountAll) {
+                        ++group.counts[i];
+                    } else if (item.aggregate != None && !batch.columns[item.column].is_null(row)) {
+                        ++group.counts[i];
+                        Cell value = cell(item.column, row);
+                        if (item.aggregate == Sum || item.aggregate == Avg) group.sums[i] += value.number;
+                        if (group.minimums[i].null || value < group.minimums[i]) group.minimums[i] = value;
+                        if (group.maximums[i].null || group.maximums[i] < value) group.maximums[i] = value;
+                    }
+                }
+            }
+            // An aggregate without group_by yields one row even for no input
+            if (groups.empty() && found.empty()) {
+                Group group;
+                group.first_row = 0;
+                group.sums.assign(items.size(), 0);
+                group.counts.assign(items.size(), 0);
+                group.minimums.assign(items.size(), Cell());
+                group.maximums.assign(items.size(), Cell());
+                found.push_back(group);
+            }
+
+            const std::vector<SelectItem>& output = items;
+
+            // Output cells per group, then sort and page
+            std::vector<std::vector<Cell>> cells(found.size());
+            std::vector<std::vector<json::value>> values(found.size());
+            for (size_t g = 0; g < found.size(); ++g) {
+                const Group& group = found[g];
+                for (size_t i = 0; i < output.size(); ++i) {
+                    const SelectItem& item = output[i];
+                    Cell value;
+                    json::value rendered = json::value::null();
+                    switch (item.aggregate) {
+                    case None:
+                        value = cell(item.column, group.first_row);
+                        rendered = render(item.column, group.first_row);
+                        break;
+                    case Count:
+                    case CountAll:
+                        value.null = false;
+                        value.number = static_cast<double>(group.counts[i]);
+                        rendered = json::value::number(group.counts[i]);
+                        break;
+                    case Sum:
+                    case Avg:
+                        if (group.counts[i] == 0) break;
+                        value.null = false;
+                        value.number = item.aggregate == Sum ? group.sums[i] : group.sums[i] / group.counts[i];
+                        rendered = json::value::number(value.number);
+                        break;
+                    case Min:
+                    case Max:
+                        value = item.aggregate == Min ? group.minimums[i] : group.maximums[i];
+                        if (!value.null) {
+                            rendered = value.is_text ? json::value::string(utility::conversions::to_string_t(value.text))
+                                                     : render_number(item.column, value.number);
+                        }
+                        break;
+                    }
+                    cells[g].push_back(value);
+                    values[g].push_back(rendered);
+                }
+            }
+
+            std::vector<size_t> order(found.size());
+            std::iota(order.begin(), order.end(), size_t(0));
+            if (!sort_keys.empty()) {
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                    for (const auto& key : sort_keys) {
+                        const Cell& left = cells[a][key.item];
+                        const Cell& right = cells[b][key.item];
+                        if (left < right) return !key.descending;
+                        if (right < left) return key.descending;
+                    }
+                    return false;
+                });
+            }
+
+            total = order.size();
+            size_t begin, end;
+            page(order.size(), limit, offset, begin, end);
+            for (size_t i = begin; i < end; ++i) {
+                json::value record = json::value::object();
+                for (size_t j = 0; j < output.size(); ++j) {
+                    record[utility::conversions::to_string_t(output[j].name)] = values[order[i]][j];
+                }
+                results[i - begin] = record;
+            }
+            return true;
+        }
+
+        std::string key_text(int column, uint32_t row) const {
+            const Column& values = batch.columns[column];
+            if (values.field.type == FieldType::Double) return std::to_string(values.doubles[row]);
+            if (values.field.type == FieldType::GeoPoint) {
+                return std::to_string(values.doubles[2 * row]) + "," + std::to_string(values.doubles[2 * row + 1]);
+            }
+            return key(column, row);
+        }
+
+        json::value render_number(int column, double value) const {
+            switch (batch.columns[column].field.type) {
+            case FieldType::Integer:
+                return json::value::number(static_cast<int64_t>(value));
+            case FieldType::Date:
+                return json::value::string(utility::conversions::to_string_t(format_date(static_cast<int64_t>(value))));
+            case FieldType::DateTime:
+                return json::value::string(utility::conversions::to_string_t(format_datetime(static_cast<int64_t>(value))));
+            default:
+                return json::value::number(value);
+            }
+        }
+    };
+
+    struct SharedState {
+        std::mutex mutex;
+        std::shared_ptr<const Store> store;
+        std::atomic<uint64_t> local{0};
+        std::atomic<uint64_t> remote{0};
+    };
+
+    OpenDataSoftAPI* api;
+    std::string dataset_id;
+    std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+
+    std::shared_ptr<const Store> snapshot() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->store;
+    }
+
+    static json::value error(const utility::string_t& message) {
+        json::value error_obj;
+        error_obj[U("error")] = json::value::string(message);
+        error_obj[U("success")] = json::value::boolean(false);
+        return error_obj;
+    }
+
+    static bool local_options(const std::string& lang, const std::string& timezone) {
+        std::string zone = trim(timezone);
+        return trim(lang).empty() && (zone.empty() || zone == "UTC" || zone == "Etc/UTC");
+    }
+
+    // Fields from_dataset_info stores as Text although the portal sends
+    // another JSON type (geo_shape, file, ...)
+    static std::vector<bool> raw_json_fields(const json::value& info, const RecordSchema& schema) {
+        std::vector<bool> raw(schema.fields.size(), false);
+        if (!info.has_field(U("fields"))) return raw;
+        for (const auto& field : info.at(U("fields")).as_array()) {
+            if (!field.has_field(U("name")) || !field.has_field(U("type"))) continue;
+            std::string type = utility::conversions::to_utf8string(field.at(U("type")).as_string());
+            if (type == "text") continue;
+            std::string name = utility::conversions::to_utf8string(field.at(U("name")).as_string());
+            int column = schema.index_of(name.data(), name.size());
+            if (column >= 0 && schema.fields[column].type == FieldType::Text) raw[column] = true;
+        }
+        return raw;
+    }
+
+    static std::string trim(const std::string& text) {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) return "";
+        size_t last = text.find_last_not_of(" \t\r\n");
+        return text.substr(first, last - first + 1);
+    }
+
+    static std::string upper(const std::string& text) {
+        std::string result(text);
+        for (auto& c : result) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        return result;
+    }
+
+    static bool keyword(const Token& token, const char* word) {
+        return token.kind == Token::Identifier && upper(token.text) == word;
+    }
+
+    // Splits on commas outside parentheses
+    static std::vector<std::string> split_list(const std::string& text) {
+        std::vector<std::string> parts;
+        int depth = 0;
+        std::string current;
+        for (char c : text) {
+            if (c == '(') ++depth;
+            if (c == ')') --depth;
+            if (c == ',' && depth == 0) {
+                parts.push_back(trim(current));
+                current.clear();
+            } else {
+                current += c;
+            }
+        }
+        if (!trim(current).empty() || !parts.empty()) parts.push_back(trim(current));
+        return parts;
+    }
+
+    static std::string unquote_identifier(const std::string& name) {
+        if (name.size() >= 2 && name.front() == '`' && name.back() == '`') return name.substr(1, name.size() - 2);
+        return name;
+    }
+
+    static bool tokenize(const std::string& text, std::vector<Token>& tokens) {
+        size_t i = 0;
+        while (i < text.size()) {
+            char c = text[i];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                ++i;
+                continue;
+            }
+            Token token;
+            if (c == '(' || c == ')' || c == ',') {
+                token.kind = c == '(' ? Token::LeftParen : c == ')' ? Token::RightParen : Token::Comma;
+                ++i;
+            } else if (c == '"' || c == '\'') {
+                token.kind = Token::String;
+                for (++i; i < text.size() && text[i] != c; ++i) {
+                    if (text[i] == '\\' && i + 1 < text.size()) ++i;
+                    token.text += text[i];
+                }
+                if (i >= text.size()) return false;
+                ++i;
+            } else if (c == '`') {
+                size_t close = text.find('`', i + 1);
+                if (close == std::string::npos) return false;
+                token.kind = Token::Identifier;
+                token.text = text.substr(i + 1, close - i - 1);
+                i = close + 1;
+            } else if (std::isdigit(static_cast<unsigned char>(c)) || (c == '-' && i + 1 < text.size() && std::isdigit(static_cast<unsigned char>(text[i + 1])))) {
+                token.kind = Token::Number;
+                size_t start = i++;
+                while (i < text.size() && (std::isdigit(static_cast<unsigned char>(text[i])) || text[i] == '.' || text[i] == 'e' || text[i] == 'E' ||
+                                           ((text[i] == '-' || text[i] == '+') && (text[i - 1] == 'e' || text[i - 1] == 'E')))) {
+                    ++i;
+                }
+                token.text = text.substr(start, i - start);
+            } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                size_t start = i;
+                while (i < text.size() && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_')) ++i;
+                token.kind = Token::Identifier;
+                token.text = text.substr(start, i - start);
+                // date'2020-01-01' is a plain string literal here
+                if (upper(token.text) == "DATE" && i < text.size() && (text[i] == '\'' || text[i] == '"')) continue;
+            } else if (c == '=' || c == '<' || c == '>' || c == '!') {
+                token.kind = Token::Operator;
+                token.text = c;
+                ++i;
+                if (i < text.size() && (text[i] == '=' || (c == '<' && text[i] == '>'))) token.text += text[i++];
+                if (token.text == "!") return false;
+            } else {
+                return false;
+            }
+            tokens.push_back(token);
+        }
+        Token end;
+        end.kind = Token::End;
+        tokens.push_back(end);
+        return true;
+    }
+
+    static bool parse_select(const Store& store, const std::string& select, std::vector<SelectItem>& items) {
+        for (const auto& part : split_list(select)) {
+            if (part.empty()) return false;
+            SelectItem item;
+            std::string expression = part;
+            item.name = part;
+
+            // "expr as alias"
+            size_t as = upper(part).rfind(" AS ");
+            if (as != std::string::npos) {
+                std::string alias = unquote_identifier(trim(part.substr(as + 4)));
+                if (alias.empty() || alias.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") != std::string::npos) return false;
+                item.name = alias;
+                expression = trim(part.substr(0, as));
+            }
+
+            if (expression == "*") {
+                item.column = -1;
+                item.aggregate = None;
+            } else if (expression.back() == ')') {
+                size_t open = expression.find('(');
+                if (open == std::string::npos) return false;
+                std::string function = upper(trim(expression.substr(0, open)));
+                std::string argument = trim(expression.substr(open + 1, expression.size() - open - 2));
+                if (function == "COUNT" && argument == "*") {
+                    item.column = -1;
+                    item.aggregate = CountAll;
+                } else {
+                    item.column = store.batch.column_index(unquote_identifier(argument));
+                    if (item.column < 0) return false;
+                    if (function == "COUNT") item.aggregate = Count;
+                    else if (function == "SUM") item.aggregate = Sum;
+                    else if (function == "AVG") item.aggregate = Avg;
+                    else if (function == "MIN") item.aggregate = Min;
+                    else if (function == "MAX") item.aggregate = Max;
+                    else return false;
+                    FieldType type = store.batch.columns[item.column].field.type;
+                    if ((item.aggregate == Sum || item.aggregate == Avg) && type != FieldType::Integer && type != FieldType::Double) return false;
+                    if ((item.aggregate == Min || item.aggregate == Max) && (type == FieldType::GeoPoint || store.raw_json[item.column])) return false;
+                }
+            } else {
+                std::string name = unquote_identifier(expression);
+                item.column = store.batch.column_index(name);
+                if (item.column < 0) return false;
+                item.aggregate = None;
+                if (item.name == part) item.name = name;
+            }
+            items.push_back(item);
+        }
+        return true;
+    }
+
+    static bool parse_fields(const Store& store, const std::string& list, std::vector<int>& columns) {
+        for (const auto& part : split_list(list)) {
+            int column = store.batch.column_index(unquote_identifier(part));
+            if (column < 0) return false;
+            columns.push_back(column);
+        }
+        return true;
+    }
+
+    static bool parse_order_by(const Store& store, const std::string& order_by, const std::vector<SelectItem>& items,
+                               bool aggregated, std::vector<SortKey>& keys) {
+        for (const auto& part : split_list(order_by)) {
+            SortKey key;
+            key.descending = false;
+            std::string expression = part;
+            std::string tail = upper(part);
+            if (tail.size() > 5 && tail.compare(tail.size() - 5, 5, " DESC") == 0) {
+                key.descending = true;
+                expression = trim(part.substr(0, part.size() - 5));
+            } else if (tail.size() > 4 && tail.compare(tail.size() - 4, 4, " ASC") == 0) {
+                expression = trim(part.substr(0, part.size() - 4));
+            }
+            std::string name = unquote_identifier(expression);
+
+            key.item = -1;
+            for (size_t i = 0; i < items.size() && key.item < 0; ++i) {
+                if (items[i].name == expression || items[i].name == name) key.item = static_cast<int>(i);
+            }
+            if (aggregated) {
+                // Aggregated rows can only be ordered by what they contain
+                if (key.item < 0) return false;
+                key.column = items[key.item].column;
+            } else {
+                key.column = key.item >= 0 ? items[key.item].column : store.batch.column_index(name);
+                if (key.column < 0) return false;
+            }
+            keys.push_back(key);
+        }
+        return true;
+    }
+
+    static void page(size_t size, int limit, int offset, size_t& begin, size_t& end) {
+        begin = offset > 0 ? std::min(size, static_cast<size_t>(offset)) : 0;
+        end = limit < 0 ? size : std::min(size, begin + static_cast<size_t>(limit));
+    }
+
+    static void civil_from_days(int64_t days, int64_t& y, unsigned& m, unsigned& d) {
+        days += 719468;
+        const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        const unsigned doe = static_cast<unsigned>(days - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+    }
+
+    static std::string format_date(int64_t days) {
+        int64_t y;
+        unsigned m, d;
+        civil_from_days(days, y, m, d);
+        char text[32];
+        std::snprintf(text, sizeof(text), "%04lld-%02u-%02u", static_cast<long long>(y), m, d);
+        return text;
+    }
+
+    static std::string format_datetime(int64_t millis) {
+        int64_t days = millis >= 0 ? millis / 86400000 : (millis - 86399999) / 86400000;
+        int64_t rest = millis - days * 86400000;
+        char text[48];
+        std::snprintf(text, sizeof(text), "%sT%02d:%02d:%02d", format_date(days).c_str(),
+                      static_cast<int>(rest / 3600000), static_cast<int>(rest / 60000 % 60), static_cast<int>(rest / 1000 % 60));
+        std::string result(text);
+        if (rest % 1000 != 0) {
+            std::snprintf(text, sizeof(text), ".%03d", static_cast<int>(rest % 1000));
+            result += text;
+        }
+        return result + "+00:00";
+    }
+
+    // Sorted-set helpers
+    static Rows intersect(const Rows& a, const Rows& b) {
+        Rows result;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+
+    static Rows unite(const Rows& a, const Rows& b) {
+        Rows result;
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+
+    static Rows difference(const Rows& a, const Rows& b) {
+        Rows result;
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,338 @@
+// Behavioral checks against the in-process mock server (see
+// bench/OpenDataSoftMockServer.h): response caching and TTLs, request
+// coalescing, retries, 429 handling and hedging, incremental sync, metrics
+// counters, and cancellation and deadlines. Each section runs its own mock
+// on its own port so request counts start from zero.
+
+#include "OpenDataSoftAPI.h"
+#include "OpenDataSoftMockServer.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static std::string base_url(int port) {
+    return "http://127.0.0.1:" + std::to_string(port) + "/api/explore/v2.1";
+}
+
+static bool failed(const json::value& result) {
+    return result.is_object() && result.has_field(U("error"));
+}
+
+static std::string error_of(const json::value& result) {
+    return failed(result) ? utility::conversions::to_utf8string(result.at(U("error")).as_string()) : "";
+}
+
+static int64_t elapsed_ms(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static OpenDataSoftMockServer::Options small_dataset() {
+    OpenDataSoftMockServer::Options options;
+    options.records = 50;
+    return options;
+}
+
+// Connection slots are released in continuations that may run just after
+// the call's task completes
+static bool slots_released(OpenDataSoftAPI& api) {
+    for (int i = 0; i < 200 && api.connection_stats().in_flight > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return api.connection_stats().in_flight == 0;
+}
+
+static void check_cache() {
+    OpenDataSoftMockServer mock(small_dataset());
+    mock.start(base_url(18101));
+    OpenDataSoftAPI api(base_url(18101));
+    api.enable_cache(1024 * 1024, "", std::chrono::seconds(1));
+
+    check(!failed(api.get_dataset_info("a").get()), "cache: first call succeeds");
+    check(!failed(api.get_dataset_info("a").get()), "cache: second call succeeds");
+    check(mock.requests_served() == 1, "cache: a fresh entry answers without a request");
+    auto stats = api.cache_stats();
+    check(stats.misses == 1 && stats.hits == 1 && stats.entries == 1, "cache: one miss, then one hit");
+
+    // Past the TTL the entry is revalidated; the mock answers 304
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    check(!failed(api.get_dataset_info("a").get()), "cache: revalidated call succeeds");
+    check(mock.requests_served() == 2 && api.cache_stats().revalidations == 1, "cache: expired entries are revalidated");
+
+    api.set_cache_ttl("/catalog/datasets/b", std::chrono::seconds(0));
+    api.get_dataset_info("b").get();
+    api.get_dataset_info("b").get();
+    check(mock.requests_served() == 4, "cache: a zero TTL bypasses the cache");
+
+    // Exports are only cached when a TTL names them
+    api.export_dataset("a", "json").get();
+    api.export_dataset("a", "json").get();
+    check(mock.requests_served() == 6, "cache: exports are not cached by default");
+
+    // Bodies larger than the budget are never cached
+    OpenDataSoftAPI small(base_url(18101));
+    small.enable_cache(256, "", std::chrono::seconds(300));
+    small.query_dataset_records("a", "", "", "", "", 20).get();
+    small.query_dataset_records("a", "", "", "", "", 20).get();
+    check(mock.requests_served() == 8 && small.cache_stats().entries == 0, "cache: oversized bodies are not cached");
+}
+
+static void check_coalescing() {
+    OpenDataSoftMockServer::Options options = small_dataset();
+    options.latency = std::chrono::milliseconds(100);
+    OpenDataSoftMockServer mock(options);
+    mock.start(base_url(18102));
+    OpenDataSoftAPI api(base_url(18102));
+
+    std::vector<pplx::task<json::value>> calls;
+    for (int i = 0; i < 5; ++i) calls.push_back(api.get_dataset_info("a"));
+    bool all_ok = true;
+    for (auto& call : calls) all_ok = !failed(call.get()) && all_ok;
+    check(all_ok, "coalescing: every caller gets the shared result");
+    check(mock.requests_served() == 1 && api.coalesced_calls() == 4, "coalescing: identical concurrent calls share one request");
+
+    // Calls with a token or deadline are sent on their own
+    calls.clear();
+    OpenDataSoftAPI::CallOptions deadline(std::chrono::milliseconds(5000));
+    for (int i = 0; i < 3; ++i) calls.push_back(api.get_dataset_info("a", OpenDataSoftQuery(), deadline));
+    for (auto& call : calls) call.get();
+    check(mock.requests_served() == 4, "coalescing: calls with CallOptions are not coalesced");
+
+    api.set_request_coalescing(false);
+    calls.clear();
+    for (int i = 0; i < 2; ++i) calls.push_back(api.get_dataset_info("a"));
+    for (auto& call : calls) call.get();
+    check(mock.requests_served() == 6, "coalescing: can be turned off");
+}
+
+static void check_retries() {
+    // Two failures, then success
+    {
+        OpenDataSoftMockServer::Options options = small_dataset();
+        options.fail_first = 2;
+        OpenDataSoftMockServer mock(options);
+        mock.start(base_url(18103));
+        OpenDataSoftAPI api(base_url(18103));
+        api.set_retry_policy(OpenDataSoftAPI::RetryPolicy(3, std::chrono::milliseconds(1), std::chrono::milliseconds(20)));
+        check(!failed(api.get_dataset_info("a").get()), "retry: the third attempt succeeds");
+        check(mock.requests_served() == 3 && api.connection_stats().retries == 2, "retry: failed attempts are retried");
+        check(slots_released(api), "retry: retried attempts release their slots");
+    }
+
+    // 429 with a Retry-After longer than the policy allows
+    {
+        OpenDataSoftMockServer::Options options = small_dataset();
+        options.error_rate = 1;
+        options.error_status = 429;
+        options.retry_after = 30;
+        OpenDataSoftMockServer mock(options);
+        mock.start(base_url(18104));
+        OpenDataSoftAPI api(base_url(18104));
+        api.set_retry_policy(OpenDataSoftAPI::RetryPolicy(3, std::chrono::milliseconds(1), std::chrono::milliseconds(50)));
+        auto started = std::chrono::steady_clock::now();
+        json::value result = api.get_dataset_info("a").get();
+        check(error_of(result) == "HTTP Error: 429", "429: the last error is returned once attempts run out");
+        check(mock.requests_served() == 3, "429: every attempt is sent");
+        check(elapsed_ms(started) < 5000, "429: Retry-After waits are capped by max_delay");
+        auto stats = api.connection_stats();
+        check(stats.throttled == 3 && stats.retries == 2, "429: responses are counted as throttled");
+        check(slots_released(api), "429: throttled attempts release their slots");
+    }
+
+    // No retries for RetryPolicy(1)
+    {
+        OpenDataSoftMockServer::Options options = small_dataset();
+        options.fail_first = 1;
+        OpenDataSoftMockServer mock(options);
+        mock.start(base_url(18105));
+        OpenDataSoftAPI api(base_url(18105));
+        api.set_retry_policy(OpenDataSoftAPI::RetryPolicy(1));
+        check(error_of(api.get_dataset_info("a").get()) == "HTTP Error: 503", "retry: RetryPolicy(1) disables retries");
+        check(mock.requests_served() == 1, "retry: RetryPolicy(1) sends one request");
+    }
+}
+
+static void check_hedging() {
+    OpenDataSoftMockServer::Options options = small_dataset();
+    options.latency = std::chrono::milliseconds(2);
+    options.jitter = std::chrono::milliseconds(30);
+    OpenDataSoftMockServer mock(options);
+    mock.start(base_url(18106));
+
+    // With every slot taken by the first request there is none for a hedge
+    OpenDataSoftAPI single(base_url(18106), 1);
+    single.set_hedging(true, 0.5, std::chrono::milliseconds(1));
+    for (int i = 0; i < 40; ++i) single.get_dataset_info("single-" + std::to_string(i)).get();
+    check(single.connection_stats().hedges == 0, "hedging: hedges never exceed max_connections");
+    check(mock.requests_served() == 40, "hedging: no second request without a free slot");
+
+    // Past the median latency, a second request goes out
+    OpenDataSoftAPI api(base_url(18106), 4);
+    api.set_hedging(true, 0.5, std::chrono::milliseconds(1));
+    uint64_t before = mock.requests_served();
+    bool all_ok = true;
+    for (int i = 0; i < 60; ++i) all_ok = !failed(api.get_dataset_info("hedged-" + std::to_string(i)).get()) && all_ok;
+    uint64_t hedges = api.connection_stats().hedges;
+    check(all_ok, "hedging: hedged calls succeed");
+    check(hedges > 0, "hedging: slow requests are hedged");
+    check(mock.requests_served() - before == 60 + hedges, "hedging: each hedge sends one extra request");
+    check(slots_released(api), "hedging: both legs release their slots");
+}
+
+static void check_sync() {
+    OpenDataSoftMockServer mock(small_dataset());
+    mock.start(base_url(18107));
+    OpenDataSoftAPI api(base_url(18107));
+    api.enable_cache();
+
+    // Snapshots go to the working directory; start from no previous run
+    const std::string id = "behavior-sync";
+    std::remove((id + ".jsonl").c_str());
+    std::remove((id + ".state.json").c_str());
+
+    api.get_dataset_info(id).get();
+    json::value first = api.sync_dataset(id, ".", "updated", "id").get();
+    check(!failed(first) && first.at(U("changed")).as_bool(), "sync: the first run fetches the dataset");
+    check(!failed(first) && first.at(U("records")).as_number().to_int64() == 50, "sync: every record is stored");
+    check(mock.requests_served() == 3, "sync: metadata and export bypass the cache");
+
+    std::ifstream snapshot(id + ".jsonl");
+    size_t lines = 0;
+    std::string line;
+    while (std::getline(snapshot, line)) lines += line.empty() ? 0 : 1;
+    check(lines == 50, "sync: the snapshot holds one line per record");
+
+    json::value second = api.sync_dataset(id, ".", "updated", "id").get();
+    check(!failed(second) && !second.at(U("changed")).as_bool(), "sync: unchanged metadata stops the run");
+    check(mock.requests_served() == 4, "sync: an unchanged dataset costs one request");
+
+    uint64_t before = mock.requests_served();
+    check(failed(api.sync_dataset("../escape", ".", "updated", "id").get()), "sync: ids with .. are rejected");
+    check(failed(api.sync_dataset("a/b", ".", "updated", "id").get()), "sync: ids with / are rejected");
+    check(failed(api.sync_dataset("a\\b", ".", "updated", "id").get()), "sync: ids with \\ are rejected");
+    check(mock.requests_served() == before, "sync: rejected ids send no request");
+
+    std::remove((id + ".jsonl").c_str());
+    std::remove((id + ".state.json").c_str());
+}
+
+static const OpenDataSoftAPI::EndpointMetrics* route(const std::vector<OpenDataSoftAPI::EndpointMetrics>& all,
+                                                     const std::string& endpoint) {
+    for (const auto& m : all) {
+        if (m.endpoint == endpoint) return &m;
+    }
+    return nullptr;
+}
+
+static void check_metrics() {
+    OpenDataSoftMockServer::Options options = small_dataset();
+    options.fail_first = 1;
+    OpenDataSoftMockServer mock(options);
+    mock.start(base_url(18108));
+    OpenDataSoftAPI api(base_url(18108));
+    api.set_retry_policy(OpenDataSoftAPI::RetryPolicy(2, std::chrono::milliseconds(1), std::chrono::milliseconds(10)));
+
+    api.get_dataset_info("a").get();
+    check(api.endpoint_metrics().empty(), "metrics: nothing is recorded while disabled");
+
+    api.enable_metrics();
+    for (int i = 0; i < 3; ++i) api.query_dataset_records("a", "", "", "", "", 5, i * 5).get();
+    api.enable_cache();
+    api.get_dataset_info("a").get();
+    api.get_dataset_info("a").get();
+
+    auto all = api.endpoint_metrics();
+    const auto* records = route(all, "/catalog/datasets/{dataset_id}/records");
+    check(records && records->calls == 3 && records->attempts == 3, "metrics: calls and attempts per route");
+    check(records && records->status_classes[2] == 3, "metrics: status classes");
+    check(records && records->response_bytes > 0, "metrics: response bytes are counted");
+    check(records && records->total.count == 3 && records->ttfb.count == 3, "metrics: latency histograms");
+    const auto* dataset = route(all, "/catalog/datasets/{dataset_id}");
+    check(dataset && dataset->calls == 2 && dataset->cache_misses == 1 && dataset->cache_hits == 1,
+          "metrics: cache hits and misses per route");
+    check(api.metrics_prometheus().find("opendatasoft_calls_total{endpoint=\"/catalog/datasets/{dataset_id}/records\"} 3") != std::string::npos,
+          "metrics: Prometheus output");
+
+    api.disable_metrics();
+    check(api.endpoint_metrics().empty(), "metrics: disabling drops what was recorded");
+}
+
+static void check_cancellation() {
+    OpenDataSoftMockServer::Options options = small_dataset();
+    options.latency = std::chrono::milliseconds(500);
+    OpenDataSoftMockServer mock(options);
+    mock.start(base_url(18109));
+    OpenDataSoftAPI api(base_url(18109), 1);
+
+    auto started = std::chrono::steady_clock::now();
+    OpenDataSoftAPI::CallOptions deadline(std::chrono::milliseconds(50));
+    json::value expired = api.get_dataset_info("a", OpenDataSoftQuery(), deadline).get();
+    check(error_of(expired) == "Deadline exceeded", "deadline: a slow call resolves to Deadline exceeded");
+    check(elapsed_ms(started) < 400, "deadline: the call ends at its deadline");
+    check(slots_released(api), "deadline: the slot is released");
+
+    pplx::cancellation_token_source source;
+    started = std::chrono::steady_clock::now();
+    auto call = api.get_dataset_info("b", OpenDataSoftQuery(), OpenDataSoftAPI::CallOptions(source.get_token()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    source.cancel();
+    check(error_of(call.get()) == "Request canceled", "cancel: a cancelled call resolves to Request canceled");
+    check(elapsed_ms(started) < 400, "cancel: the call ends when cancelled");
+
+    pplx::cancellation_token_source early;
+    early.cancel();
+    uint64_t before = mock.requests_served();
+    check(error_of(api.get_dataset_info("c", OpenDataSoftQuery(), OpenDataSoftAPI::CallOptions(early.get_token())).get()) ==
+              "Request canceled",
+          "cancel: an already cancelled token fails the call");
+    check(mock.requests_served() == before, "cancel: an already cancelled call sends nothing");
+
+    // Waiting for the only connection slot also ends at the deadline
+    check(slots_released(api), "cancel: slots are released");
+    auto holder = api.get_dataset_info("d");
+    started = std::chrono::steady_clock::now();
+    json::value queued = api.get_dataset_info("e", OpenDataSoftQuery(), deadline).get();
+    check(error_of(queued) == "Deadline exceeded", "deadline: waiting for a slot is bounded");
+    check(elapsed_ms(started) < 400, "deadline: the slot wait ends at the deadline");
+    check(!failed(holder.get()), "deadline: the call holding the slot is unaffected");
+
+    // A retry wait stops at the deadline too
+    OpenDataSoftMockServer::Options throttled = small_dataset();
+    throttled.error_rate = 1;
+    throttled.error_status = 429;
+    throttled.retry_after = 5;
+    OpenDataSoftMockServer limited(throttled);
+    limited.start(base_url(18110));
+    OpenDataSoftAPI retrying(base_url(18110));
+    retrying.set_retry_policy(OpenDataSoftAPI::RetryPolicy(3, std::chrono::milliseconds(100), std::chrono::milliseconds(10000)));
+    started = std::chrono::steady_clock::now();
+    json::value waited = retrying.get_dataset_info("a", OpenDataSoftQuery(), OpenDataSoftAPI::CallOptions(std::chrono::milliseconds(100))).get();
+    check(error_of(waited) == "Deadline exceeded", "deadline: a retry wait resolves to Deadline exceeded");
+    check(elapsed_ms(started) < 2000, "deadline: the retry wait ends at the deadline");
+    check(slots_released(api) && slots_released(retrying), "cancel: every slot is released");
+}
+
+int main() {
+    check_cache();
+    check_coalescing();
+    check_retries();
+    check_hedging();
+    check_sync();
+    check_metrics();
+    check_cancellation();
+
+    if (failures == 0) std::cout << "behavior_check passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
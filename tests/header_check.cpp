@@ -0,0 +1,55 @@
+// Builds every core header in one translation unit and runs offline checks
+// that need no server.
+
+#include "OpenDataSoftAPI.h"
+#include "OpenDataSoftQuery.h"
+#include "OpenDataSoftRecordBatch.h"
+#include "OpenDataSoftReplica.h"
+#include <iostream>
+#include <string>
+#include <cstring>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+int main() {
+    OpenDataSoftQuery query;
+    query.where("a = 'b'").limit(5).param("facet", "year");
+    check(query.endpoint("/catalog/datasets") == "/catalog/datasets?where=a%20%3D%20%27b%27&limit=5&facet=year",
+          "Query encodes values once, in field order");
+    OpenDataSoftQuery same;
+    same.limit(5).where("a = 'b'").param("facet", "year");
+    check(query == same && std::hash<OpenDataSoftQuery>()(query) == std::hash<OpenDataSoftQuery>()(same),
+          "equal queries compare and hash equal");
+
+    RecordSchema schema;
+    FieldSchema id = {"id", FieldType::Integer};
+    FieldSchema name = {"name", FieldType::Text};
+    schema.fields.push_back(id);
+    schema.fields.push_back(name);
+    RecordBatch batch(schema);
+    RecordBatchDecoder decoder(schema);
+    const char* body = "{\"results\": [{\"id\": 9007199254740993, \"name\": \"a\"}, {\"id\": 1.5}, {\"name\": \"c\\\"d\", \"id\": 1e3}]}";
+    std::string error;
+    check(decoder.decode_response(body, std::strlen(body), batch, &error), "decoder accepts a /records body");
+    check(batch.num_rows == 3, "decoder appends one row per record");
+    const Column& ids = batch.columns[0];
+    check(ids.valid[0] && ids.ints[0] == 9007199254740993LL, "integers above 2^53 keep every digit");
+    check(!ids.valid[1], "fractional values in integer columns become null");
+    check(ids.valid[2] && ids.ints[2] == 1000, "whole numbers in exponent form are kept");
+    check(batch.columns[1].is_null(1) && batch.columns[1].text(2) == "c\"d", "missing and escaped text fields");
+
+    OpenDataSoftAPI api("http://127.0.0.1:9/api/explore/v2.1");
+    check(api.base_url() == "http://127.0.0.1:9/api/explore/v2.1", "base URL is kept");
+    OpenDataSoftReplica replica(api, "dataset");
+    check(!replica.loaded(), "a new replica holds no data");
+
+    if (failures == 0) std::cout << "header_check passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
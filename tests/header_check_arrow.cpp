@@ -0,0 +1,27 @@
+// Builds the optional Arrow/Parquet header and converts a decoded batch.
+
+#include "OpenDataSoftArrow.h"
+#include <iostream>
+#include <cstring>
+
+int main() {
+    RecordSchema schema;
+    FieldSchema id = {"id", FieldType::Integer};
+    FieldSchema name = {"name", FieldType::Text};
+    schema.fields.push_back(id);
+    schema.fields.push_back(name);
+    RecordBatch batch(schema);
+    RecordBatchDecoder decoder(schema);
+    const char* body = "[{\"id\": 1, \"name\": \"a\"}, {\"id\": 2}]";
+    if (!decoder.decode_response(body, std::strlen(body), batch)) {
+        std::cerr << "FAILED: decode" << std::endl;
+        return 1;
+    }
+    auto converted = to_arrow(batch, arrow_schema(schema));
+    if (!converted.ok() || (*converted)->num_rows() != 2 || (*converted)->column(1)->null_count() != 1) {
+        std::cerr << "FAILED: to_arrow" << std::endl;
+        return 1;
+    }
+    std::cout << "header_check_arrow passed" << std::endl;
+    return 0;
+}
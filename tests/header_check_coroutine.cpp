@@ -0,0 +1,23 @@
+// Builds the optional C++20 coroutine header and awaits finished and
+// pending tasks without a server.
+
+#include "OpenDataSoftCoroutine.h"
+#include <iostream>
+
+static pplx::task<int> add(pplx::task<int> a, pplx::task<int> b) {
+    int x = co_await a;
+    int y = co_await b;
+    co_return x + y;
+}
+
+int main() {
+    pplx::task_completion_event<int> later;
+    auto sum = add(pplx::task_from_result(2), pplx::create_task(later));
+    later.set(3);
+    if (sum.get() != 5) {
+        std::cerr << "FAILED: co_await on pplx::task" << std::endl;
+        return 1;
+    }
+    std::cout << "header_check_coroutine passed" << std::endl;
+    return 0;
+}
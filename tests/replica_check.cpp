@@ -0,0 +1,242 @@
+// Table-driven checks of OpenDataSoftReplica's local query evaluation over a
+// five-row dataset served from memory. Each case runs try_query_records and
+// compares the rows it returns, or expects the query to be left to the
+// remote API.
+
+#include "OpenDataSoftAPI.h"
+#include "OpenDataSoftReplica.h"
+#include <cpprest/http_listener.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace web;
+using namespace web::http;
+
+static int failures = 0;
+
+// Fields id (int), name (text), x (int), score (double) and day (date), with
+// one null in each of the last four
+static const char* dataset_info =
+    "{\"dataset_id\": \"demo\", \"fields\": [{\"name\": \"id\", \"type\": \"int\"}, {\"name\": \"name\", \"type\": \"text\"}"
+    ", {\"name\": \"x\", \"type\": \"int\"}, {\"name\": \"score\", \"type\": \"double\"}, {\"name\": \"day\", \"type\": \"date\"}]}";
+
+static const char* dataset_records =
+    "[{\"id\": 1, \"name\": \"a\", \"x\": 1, \"score\": 1.5, \"day\": \"2024-01-01\"}"
+    ", {\"id\": 2, \"name\": \"b\", \"x\": null, \"score\": 2.5, \"day\": \"2024-01-02\"}"
+    ", {\"id\": 3, \"name\": \"a\", \"x\": 3, \"day\": \"2024-01-03\"}"
+    ", {\"id\": 4, \"name\": \"c\", \"x\": 1, \"score\": 4.0, \"day\": null}"
+    ", {\"id\": 5, \"x\": 5, \"score\": 0.5, \"day\": \"2024-01-05\"}]";
+
+// Sentinel for queries outside the local subset
+static const char* remote = "<remote>";
+
+struct FilterCase {
+    const char* where;
+    const char* refine;
+    const char* exclude;
+    const char* ids;    // matching ids in id order, or remote
+};
+
+static const FilterCase filter_cases[] = {
+    // Comparisons, through the hash and sorted indexes
+    {"", "", "", "1,2,3,4,5"},
+    {"x = 1", "", "", "1,4"},
+    {"`x` = 1", "", "", "1,4"},
+    {"x != 1", "", "", "3,5"},
+    {"x <> 1", "", "", "3,5"},
+    {"x >= 3", "", "", "3,5"},
+    {"x < 3", "", "", "1,4"},
+    {"x > 1 AND x <= 5", "", "", "3,5"},
+    {"x > 5", "", "", ""},
+    {"score > 1", "", "", "1,2,4"},
+    {"score <= 1.5", "", "", "1,5"},
+    {"score = 4", "", "", "4"},
+    {"day >= date'2024-01-02'", "", "", "2,3,5"},
+    {"day < \"2024-01-03\"", "", "", "1,2"},
+    {"name = 'a'", "", "", "1,3"},
+    {"name > 'a'", "", "", "2,4"},
+    {"name = 'a\\'b'", "", "", ""},
+    {"x = 1 OR x = 5", "", "", "1,4,5"},
+    {"(x = 1 OR x = 5) AND score > 1", "", "", "1,4"},
+    {"x = 1 or not x < 5", "", "", "1,4,5"},
+
+    // Three-valued logic: a comparison on null is unknown, and so is its NOT
+    {"x IS NULL", "", "", "2"},
+    {"x IS NOT NULL", "", "", "1,3,4,5"},
+    {"NOT x IS NULL", "", "", "1,3,4,5"},
+    {"NOT x = 1", "", "", "3,5"},
+    {"NOT (x = 1)", "", "", "3,5"},
+    {"NOT NOT x = 1", "", "", "1,4"},
+    {"NOT (x = 1 OR name = 'b')", "", "", "3"},
+    {"NOT (x = 1 AND name = 'a')", "", "", "2,3,4,5"},
+    {"NOT (x = 3 OR score > 2)", "", "", "1,5"},
+    {"NOT (NOT (x = 1))", "", "", "1,4"},
+
+    // refine / exclude
+    {"", "name:a", "", "1,3"},
+    {"", "x:\"1\"", "", "1,4"},
+    {"", "", "name:a", "2,4,5"},
+    {"x >= 1", "", "x:1", "3,5"},
+    {"", "score:1.5", "", remote},
+
+    // Outside the tokenizer or parser: left to the API
+    {"x LIKE 'a'", "", "", remote},
+    {"(x = 1", "", "", remote},
+    {"x = 1)", "", "", remote},
+    {"x = 1 AND", "", "", remote},
+    {"x ! 1", "", "", remote},
+    {"name = 'open", "", "", remote},
+    {"`x = 1", "", "", remote},
+    {"missing = 1", "", "", remote},
+    {"x = 'a'", "", "", remote},
+    {"name = 1", "", "", remote},
+    {"x = 1 ; x = 2", "", "", remote},
+};
+
+struct QueryCase {
+    const char* select;
+    const char* where;
+    const char* group_by;
+    const char* order_by;
+    int limit;
+    int offset;
+    const char* rows;    // "key=value ..." per row, keys sorted, "; " between rows, or remote
+};
+
+static const QueryCase query_cases[] = {
+    // Aggregates without group_by yield one row, even for no input
+    {"count(*) as n", "", "", "", 10, 0, "n=5"},
+    {"count(x) as n", "", "", "", 10, 0, "n=4"},
+    {"count(*) as n", "x > 100", "", "", 10, 0, "n=0"},
+    {"sum(x) as s", "", "", "", 10, 0, "s=10"},
+    {"sum(score) as s", "", "", "", 10, 0, "s=8.5"},
+    {"avg(score) as a", "", "", "", 10, 0, "a=2.125"},
+    {"avg(x) as a", "x IS NULL", "", "", 10, 0, "a=null"},
+    {"min(score) as lo, max(score) as hi", "", "", "", 10, 0, "hi=4 lo=0.5"},
+    {"min(x) as lo, max(x) as hi", "", "", "", 10, 0, "hi=5 lo=1"},
+    {"min(day) as lo, max(day) as hi", "", "", "", 10, 0, "hi=2024-01-05 lo=2024-01-01"},
+    {"min(name) as lo, max(name) as hi", "", "", "", 10, 0, "hi=c lo=a"},
+    {"min(x) as lo", "x IS NULL", "", "", 10, 0, "lo=null"},
+    {"sum(name) as s", "", "", "", 10, 0, remote},
+    {"median(x) as m", "", "", "", 10, 0, remote},
+
+    // group_by, ordered by aggregates and groups; null groups sort last
+    {"name, count(*) as n", "", "name", "n DESC, name", 10, 0, "n=2 name=a; n=1 name=b; n=1 name=c; n=1 name=null"},
+    {"x, sum(score) as s", "", "x", "x", 10, 0, "s=5.5 x=1; s=null x=3; s=0.5 x=5; s=2.5 x=null"},
+    {"", "", "name", "name DESC", 2, 0, "name=null; name=c"},
+    {"name, count(*) as n", "x IS NOT NULL", "name", "name", 10, 1, "n=1 name=c; n=1 name=null"},
+    {"x", "", "name", "", 10, 0, remote},
+    {"count(*) as n", "", "name", "score", 10, 0, remote},
+    {"count(*) as n", "", "missing", "", 10, 0, remote},
+
+    // order_by on plain rows, with paging
+    {"id", "", "", "score DESC", 10, 0, "id=3; id=4; id=2; id=1; id=5"},
+    {"id", "", "", "name, id DESC", 10, 0, "id=3; id=1; id=2; id=4; id=5"},
+    {"id, day", "day IS NOT NULL", "", "day DESC", 2, 0, "day=2024-01-05 id=5; day=2024-01-03 id=3"},
+    {"id", "", "", "id", 2, 1, "id=2; id=3"},
+    {"id as key", "", "", "key DESC", 10, 3, "key=2; key=1"},
+    {"id", "", "", "missing", 10, 0, remote},
+};
+
+static std::string describe_value(const json::value& value) {
+    if (value.is_null()) return "null";
+    if (value.is_string()) return utility::conversions::to_utf8string(value.as_string());
+    if (value.is_number() && value.is_integer()) return std::to_string(value.as_number().to_int64());
+    if (value.is_number()) {
+        std::ostringstream out;
+        out << value.as_double();
+        return out.str();
+    }
+    return utility::conversions::to_utf8string(value.serialize());
+}
+
+// Renders result rows as "key=value ..." with keys sorted, rows joined by "; "
+static std::string describe(const json::value& results) {
+    std::string text;
+    for (const auto& row : results.as_array()) {
+        std::vector<std::string> cells;
+        for (const auto& field : row.as_object()) {
+            cells.push_back(utility::conversions::to_utf8string(field.first) + "=" + describe_value(field.second));
+        }
+        std::sort(cells.begin(), cells.end());
+        if (!text.empty()) text += "; ";
+        for (size_t i = 0; i < cells.size(); ++i) text += (i == 0 ? "" : " ") + cells[i];
+    }
+    return text;
+}
+
+static std::string ids_of(const json::value& results) {
+    std::string text;
+    for (const auto& row : results.as_array()) {
+        if (!text.empty()) text += ",";
+        text += describe_value(row.at(U("id")));
+    }
+    return text;
+}
+
+static void expect(const std::string& actual, const char* expected, const std::string& what) {
+    if (actual != expected) {
+        std::cerr << "FAILED: " << what << "\n  expected: " << expected << "\n  actual:   " << actual << std::endl;
+        ++failures;
+    }
+}
+
+int main() {
+    const std::string base = "http://127.0.0.1:18090/api/explore/v2.1";
+    experimental::listener::http_listener listener(utility::conversions::to_string_t(base));
+    listener.support(methods::GET, [](http_request request) {
+        auto path = utility::conversions::to_utf8string(request.relative_uri().path());
+        if (path == "/catalog/datasets/demo") {
+            request.reply(status_codes::OK, utility::conversions::to_string_t(dataset_info), U("application/json"));
+        } else if (path == "/catalog/datasets/demo/exports/json") {
+            request.reply(status_codes::OK, utility::conversions::to_string_t(dataset_records), U("application/json"));
+        } else {
+            request.reply(status_codes::NotFound);
+        }
+    });
+    listener.open().wait();
+
+    OpenDataSoftAPI api(base);
+    OpenDataSoftReplica replica(api, "demo");
+    json::value loaded = replica.load().get();
+    if (!replica.loaded() || replica.size() != 5) {
+        std::cerr << "FAILED: replica load: " << utility::conversions::to_utf8string(loaded.serialize()) << std::endl;
+        return 1;
+    }
+
+    for (const auto& c : filter_cases) {
+        json::value result;
+        bool local = replica.try_query_records("id", c.where, "", "id", 100, 0, c.refine, c.exclude, "", "", result);
+        std::string what = std::string("where \"") + c.where + "\" refine \"" + c.refine + "\" exclude \"" + c.exclude + "\"";
+        expect(local ? ids_of(result.at(U("results"))) : remote, c.ids, what);
+    }
+
+    for (const auto& c : query_cases) {
+        json::value result;
+        bool local = replica.try_query_records(c.select, c.where, c.group_by, c.order_by, c.limit, c.offset, "", "", "", "", result);
+        std::string what = std::string("select \"") + c.select + "\" where \"" + c.where + "\" group_by \"" + c.group_by +
+                           "\" order_by \"" + c.order_by + "\"";
+        expect(local ? describe(result.at(U("results"))) : remote, c.rows, what);
+    }
+
+    // total_count counts matching rows (or groups) before paging
+    json::value paged;
+    replica.try_query_records("id", "x IS NOT NULL", "", "id", 1, 1, "", "", "", "", paged);
+    expect(describe_value(paged.at(U("total_count"))), "4", "total_count ignores limit and offset");
+    json::value grouped;
+    replica.try_query_records("name", "", "name", "", 1, 0, "", "", "", "", grouped);
+    expect(describe_value(grouped.at(U("total_count"))), "4", "total_count of a grouped query counts groups");
+
+    // lang and non-UTC timezones always go to the API
+    json::value ignored;
+    expect(replica.try_query_records("id", "", "", "", 10, 0, "", "", "fr", "", ignored) ? "local" : remote, remote, "lang");
+    expect(replica.try_query_records("id", "", "", "", 10, 0, "", "", "", "Europe/Paris", ignored) ? "local" : remote, remote,
+           "timezone");
+
+    listener.close().wait();
+    if (failures == 0) std::cout << "replica_check passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}